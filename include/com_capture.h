@@ -0,0 +1,87 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_CAPTURE_H
+#define COM_CAPTURE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Binary traffic capture. The file starts with the 8 byte header
+// "NCAP" + quint16 version + quint16 reserved, followed by records of a
+// 16 byte little-endian header (qint64 timestamp, quint16 port id,
+// quint8 direction, quint8 reserved, quint32 size) and the raw bytes.
+// Records are collected in memory and written to the file in blocks.
+//==============================================================================
+class ComCapture : public QObject
+{
+    Q_OBJECT
+
+    const int defaultBlockSize {262144};
+
+public:
+    enum Direction {
+        DirectionRx = 0,
+        DirectionTx
+    };
+    Q_ENUM(Direction)
+
+    static const quint16 formatVersion {1};
+    static const int fileHeaderSize {8};
+    static const int recordHeaderSize {16};
+
+    explicit ComCapture(QObject *parent = nullptr);
+    ~ComCapture();
+    QString lastError() const;
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    int blockSize() const;
+    void setBlockSize(int blockSize);
+    quint64 recordCount() const;
+    quint64 byteCount() const;
+    void append(Direction direction, quint16 portId, qint64 timestamp,
+                const char *data, qint64 size);
+    static QByteArray fileMagic();
+
+public slots:
+    bool flush();
+
+private:
+    QFile m_file;
+    QString m_lastError {""};
+    QByteArray m_block;
+    int m_blockSize {defaultBlockSize};
+    quint64 m_recordCount {0};
+    quint64 m_byteCount {0};
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_CAPTURE_H
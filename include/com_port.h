@@ -29,6 +29,16 @@
 #include <QVariant>
 #include <QtSerialPort/QSerialPort>
 #include <QByteArray>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QPointer>
+#include <atomic>
+#include <functional>
+
+#include "com_capture.h"
+#include "com_port_metrics.h"
 
 #if defined (QT_GUI_LIB)
 #    include <QComboBox>
@@ -40,15 +50,25 @@
 
 namespace nayk { //=============================================================
 
+class ComPortPrivate;
+
 //==============================================================================
 class ComPort : public QObject
 {
     Q_OBJECT
+
+    friend class ComPortPrivate;
     Q_PROPERTY(QString lastError READ lastError CONSTANT)
 
     const QChar  defaultXOn {17};
     const QChar  defaultXOff {19};
     const qint64 defaultBufferSize {1024};
+    const int defaultTxCoalesceWindow {2};
+    const qint64 defaultTxCoalesceThreshold {512};
+    const qint64 defaultTxQueueLimit {1048576};
+    const int txLatencySamples {1024};
+    const int defaultReconnectInterval {500};
+    const int defaultMaxReconnectInterval {10000};
 
 public:
 #if defined (QT_GUI_LIB)
@@ -62,21 +82,63 @@ public:
     };
     Q_ENUM(PortProperty)
 #endif
+    enum LogVerbosity {
+        VerbosityQuiet = 0,
+        VerbosityErrors,
+        VerbosityInfo,
+        VerbosityTraffic,
+        VerbosityDebug
+    };
+    Q_ENUM(LogVerbosity)
+    enum OverflowPolicy {
+        OverflowBlock = 0,
+        OverflowDropOldest,
+        OverflowDropNewest
+    };
+    Q_ENUM(OverflowPolicy)
+    enum Backend {
+        BackendQt = 0,
+        BackendNative,
+        BackendVirtual
+    };
+    Q_ENUM(Backend)
+
+    struct Settings {
+        QString portName;
+        qint32 baudRate {QSerialPort::Baud9600};
+        QSerialPort::DataBits dataBits {QSerialPort::Data8};
+        QSerialPort::StopBits stopBits {QSerialPort::OneStop};
+        QSerialPort::Parity parity {QSerialPort::NoParity};
+        QSerialPort::FlowControl flowControl {QSerialPort::NoFlowControl};
+    };
+
     explicit ComPort(QObject *parent = nullptr);
+    ~ComPort();
     QString lastError() const;
     void setPortName(const QString &portName);
     bool setBaudRate(QSerialPort::BaudRate baudRate);
+    bool setBaudRate(qint32 baudRate);
     bool setDataBits(QSerialPort::DataBits dataBits);
     bool setStopBits(QSerialPort::StopBits stopBits);
     bool setParity(QSerialPort::Parity parity);
     bool setFlowControl(QSerialPort::FlowControl flowControl);
+    Settings settings() const;
+    bool applySettings(const Settings &settings);
     bool open(bool readOnly = false);
+    bool open(const Settings &settings, bool readOnly = false);
     void close();
     bool isOpen() const;
     bool isReady();
     qint64 write(const QByteArray &bytes);
+    qint64 writeUrgent(const QByteArray &bytes);
     QByteArray read(qint64 count = -1);
+    qint64 read(QByteArray &buffer, qint64 count = -1);
+    qint64 read(char *data, qint64 maxSize);
+    qint64 bytesAvailable() const;
     QByteArray readBuffer() const;
+    qint64 lastReadTimestamp() const;
+    qint64 byteTimestamp(qint64 index) const;
+    qint64 charTime() const;
     qint64 bufferSize() const;
     void setBufferSize(const qint64 &bufferSize);
     QChar charXon() const;
@@ -85,25 +147,86 @@ public:
     void setCharXoff(const QChar &charXoff);
     bool autoRead() const;
     void setAutoRead(bool autoRead);
+    bool backpressure() const;
+    bool setBackpressure(bool backpressure);
+    OverflowPolicy overflowPolicy() const;
+    bool setOverflowPolicy(OverflowPolicy overflowPolicy);
+    quint64 overflowDropped() const;
+    bool threadedMode() const;
+    bool setThreadedMode(bool threadedMode);
+    QThread *ioThread() const;
+    bool setIoThread(QThread *ioThread);
+    qint64 ringBufferCapacity() const;
+    bool setRingBufferCapacity(qint64 capacity);
+    qint64 ringBufferFill() const;
+    qint64 ringBufferHighWater() const;
+    quint64 ringBufferOverflow() const;
+    quint64 ringBufferDropped() const;
+    void resetRingBufferStatistics();
+    Backend backend() const;
+    bool setBackend(Backend backend);
+    int readMinimum() const;
+    bool setReadMinimum(int readMinimum);
+    int readTimeout() const;
+    bool setReadTimeout(int deciseconds);
+    bool lowLatency() const;
+    void setLowLatency(bool lowLatency);
+    bool autoReconnect() const;
+    void setAutoReconnect(bool autoReconnect);
+    int reconnectInterval() const;
+    int maxReconnectInterval() const;
+    void setReconnectInterval(int msec, int maxMsec);
+    bool isReconnecting() const;
+    quint64 reconnectCount() const;
+    qint64 downtime() const;
+    void resetReconnectStatistics();
+    LogVerbosity logVerbosity() const;
+    void setLogVerbosity(LogVerbosity logVerbosity);
+    bool txQueueEnabled() const;
+    void setTxQueueEnabled(bool enabled);
+    int txCoalesceWindow() const;
+    void setTxCoalesceWindow(int msec);
+    qint64 txCoalesceThreshold() const;
+    void setTxCoalesceThreshold(qint64 bytes);
+    qint64 txQueueLimit() const;
+    void setTxQueueLimit(qint64 bytes);
+    qint64 txQueueSize() const;
+    int txQueueDepth() const;
+    qint64 txLatencyPercentile(double percentile) const;
+    const ComPortMetrics &metrics() const;
+    void resetMetrics();
+    ComCapture *capture() const;
+    void setCapture(ComCapture *capture, quint16 portId = 0);
+    void replayReceived(const char *data, qint64 size, qint64 timestamp);
 
 #if defined (QT_GUI_LIB)
     static void fillComboBoxPortProperty(QComboBox *comboBox, PortProperty portProperty,
                                          const QVariant &defaultValue = QVariant());
 #endif
+    static qint64 monotonicTime();
+    static qint64 charTime(qint32 baudRate, QSerialPort::DataBits dataBits,
+                           QSerialPort::Parity parity, QSerialPort::StopBits stopBits);
+    static bool validateSettings(const Settings &settings, QString *errorString = nullptr);
     static QString baudRateToStr(QSerialPort::BaudRate baudRate);
+    static QString baudRateToStr(qint32 baudRate);
     static QString dataBitsToStr(QSerialPort::DataBits dataBits);
     static QString stopBitsToStr(QSerialPort::StopBits stopBits);
     static QString parityToStr(QSerialPort::Parity parity);
     static QString flowControlToStr(QSerialPort::FlowControl flowControl);
     static QSerialPort::BaudRate strToBaudRate(const QString &value);
+    static qint32 strToBaudRateValue(const QString &value);
     static QSerialPort::DataBits strToDataBits(const QString &value);
     static QSerialPort::StopBits strToStopBits(const QString &value);
     static QSerialPort::Parity strToParity(const QString &value);
     static QSerialPort::FlowControl strToFlowControl(const QString &value);
 
+public slots:
+    void flushTxQueue();
+
 signals:
 #if !defined (WITHOUT_LOG)
     void toLog(const QString &text, Log::LogType logType = Log::LogInfo);
+    void traffic(const QByteArray &bytes, Log::LogType logType);
 #endif
     void portError();
     void beforeOpen();
@@ -111,28 +234,110 @@ signals:
     void beforeClose();
     void afterClose();
     void bytesRead(qint64 count);
+    void received(const QByteArray &bytes, qint64 timestamp);
+    void bytesReadAt(qint64 count, qint64 timestamp);
     void bytesWrite(qint64 count);
     void readyChange(bool ready);
     void rts(bool on);
     void dtr(bool on);
     void xon(bool on);
     void readyRead();
+    void disconnected();
+    void reconnected();
 
 private:
+    ComPortPrivate *m_private {nullptr};
     QSerialPort serialPort;
+    Settings m_settings;
     QString m_lastError {""};
     bool m_autoRead {true};
     bool m_ready {false};
+    std::atomic<bool> m_requestToSend {false};
     qint64 m_bufferSize {defaultBufferSize};
     QChar m_charXon {defaultXOn};
     QChar m_charXoff {defaultXOff};
     QByteArray m_buffer;
+    qint64 m_rxTimestamp {0};
+    qint64 m_lastReadTimestamp {0};
+    qint64 m_lastReadSize {0};
+    bool m_threadedMode {false};
+    QThread *m_ioThread {nullptr};
+    QPointer<QThread> m_sharedIoThread;
+    std::atomic<bool> m_ringNotifyPending {false};
+    bool m_backpressure {false};
+    OverflowPolicy m_overflowPolicy {OverflowBlock};
+    bool m_readyReadArmed {true};
+    std::atomic<qint64> m_backlogLimit {0};
+    std::atomic<bool> m_producerPaused {false};
+    std::atomic<quint64> m_overflowDropped {0};
+    std::atomic<quint64> m_overflowReport {0};
+    LogVerbosity m_logVerbosity {VerbosityDebug};
+    Backend m_backend {BackendQt};
+    bool m_virtualOpen {false};
+    bool m_openReadOnly {false};
+    bool m_autoReconnect {false};
+    bool m_reconnecting {false};
+    int m_reconnectInterval {defaultReconnectInterval};
+    int m_maxReconnectInterval {defaultMaxReconnectInterval};
+    int m_currentReconnectInterval {defaultReconnectInterval};
+    quint64 m_reconnectCount {0};
+    qint64 m_downtime {0};
+    QTimer m_reconnectTimer;
+    QElapsedTimer m_downClock;
+
+    struct TxEntry {
+        qint64 enqueueTime;
+        qint64 size;
+    };
+
+    bool m_txQueueEnabled {false};
+    int m_txCoalesceWindow {defaultTxCoalesceWindow};
+    qint64 m_txCoalesceThreshold {defaultTxCoalesceThreshold};
+    qint64 m_txQueueLimit {defaultTxQueueLimit};
+    QByteArray m_txQueue;
+    QVector<TxEntry> m_txEntries;
+    QVector<qint64> m_txLatencies;
+    int m_txLatencyIndex {0};
+    QTimer m_txTimer;
+    QElapsedTimer m_txClock;
+    ComPortMetrics m_metrics;
+    QPointer<ComCapture> m_capture;
+    quint16 m_capturePortId {0};
+
+    void startIoThread();
+    void stopIoThread();
+    void runInPortThread(const std::function<void()> &func);
+    void ioThread_readyRead();
+    void fillRingBuffer();
+    void reportOverflow(qint64 dropped);
+    qint64 producerLimit() const;
+    void resumeProducer();
+    void notifyRingBuffer();
+    bool useRingBuffer() const;
+    bool openDevice(bool readOnly);
+    void closeDevice();
+    bool devicePresent() const;
+    void linkLost();
+    void stopReconnect();
+    bool openNative(bool readOnly);
+    void nativePort_error(const QString &errorString);
+    void receiveVirtual(const char *data, qint64 size, qint64 timestamp);
+    bool checkPortOpen();
+    qint64 readData(char *data, qint64 maxSize);
+    void processReceived(const char *data, qint64 size, const QByteArray *bytes = nullptr);
+    qint64 writeData(const char *data, qint64 size);
+    void addTxLatency(qint64 usec);
+#if !defined (WITHOUT_LOG)
+    bool logEnabled(Log::LogType logType) const;
+    void logTraffic(const char *data, qint64 size, Log::LogType logType);
+#endif
 
 private slots:
-    void serialPort_errorOccurred(QSerialPort::SerialPortError error);
+    void serialPort_errorOccurred(QSerialPort::SerialPortError error, const QString &errorString);
     void serialPort_requestToSendChanged(bool set);
     void serialPort_dataTerminalReadyChanged(bool set);
     void serialPort_readyRead();
+    void reconnectTimer_timeout();
 };
 //==============================================================================
 
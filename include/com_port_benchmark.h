@@ -0,0 +1,158 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_BENCHMARK_H
+#define COM_PORT_BENCHMARK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QTimer>
+#include <QPointer>
+
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Sender -> receiver round trip over two open ports (a VirtualSerialLink pair
+// or a pty loopback). The read mode selects how the receiver is drained:
+// ReadAuto keeps the port's own autoRead, ReadCopy and ReadInto drain it on
+// readyRead through read() and read(QByteArray&), and count how often the
+// buffer handed to the consumer had to be (re)allocated. Only that buffer is
+// counted: QSerialPort keeps its own internal read buffer (in threaded mode
+// too, in front of the ring buffer), and its allocations are not measured
+// here. The ring buffer itself is allocated once, at setCapacity().
+// runTrafficLog() pushes chunks through the receive path of a closed port
+// with the toLog sink disconnected, connected but filtered by verbosity, and
+// connected with every line formatted, as all of them were before.
+// runFlowScan() times the receive path with software flow control over a
+// multi-megabyte chunk against the former per-byte XON/XOFF loop.
+class ComPortBenchmark : public QObject
+{
+    Q_OBJECT
+
+    const int defaultChunkSize {256};
+    const qint64 defaultTotalBytes {1048576};
+    const int defaultWindow {4};
+    const int defaultTimeout {30000};
+
+public:
+    enum ReadMode {
+        ReadAuto = 0,
+        ReadCopy,
+        ReadInto
+    };
+    Q_ENUM(ReadMode)
+
+    struct Result {
+        qint64 bytesSent {0};
+        qint64 bytesReceived {0};
+        qint64 elapsed {0};
+        double throughput {0.0};
+        qint64 latencyMin {0};
+        qint64 latencyAverage {0};
+        qint64 latencyMax {0};
+        double cpuPerByte {0.0};
+        quint64 allocations {0};
+        double allocationsPerMB {0.0};
+        bool timedOut {false};
+    };
+
+    struct TrafficLogResult {
+        qint64 chunks {0};
+        int chunkSize {0};
+        double unconnectedChunksPerSecond {0.0};
+        double filteredChunksPerSecond {0.0};
+        double formattedChunksPerSecond {0.0};
+    };
+
+    struct FlowScanResult {
+        qint64 bufferSize {0};
+        int rounds {0};
+        double legacyBytesPerSecond {0.0};
+        double bytesPerSecond {0.0};
+        bool matched {false};
+    };
+
+    explicit ComPortBenchmark(QObject *parent = nullptr);
+    void setPorts(ComPort *sender, ComPort *receiver);
+    int chunkSize() const;
+    void setChunkSize(int chunkSize);
+    qint64 totalBytes() const;
+    void setTotalBytes(qint64 totalBytes);
+    int window() const;
+    void setWindow(int chunks);
+    int timeout() const;
+    void setTimeout(int msec);
+    ReadMode readMode() const;
+    void setReadMode(ReadMode readMode);
+    bool isRunning() const;
+    Result result() const;
+    static qint64 cpuTime();
+    static FlowScanResult runFlowScan(qint64 bufferSize = 8388608, int rounds = 16);
+#if !defined (WITHOUT_LOG)
+    static TrafficLogResult runTrafficLog(int chunks = 100000, int chunkSize = 64);
+#endif
+
+signals:
+    void finished(const nayk::ComPortBenchmark::Result &result);
+
+public slots:
+    bool start();
+    void stop();
+
+private:
+    QPointer<ComPort> m_sender;
+    QPointer<ComPort> m_receiver;
+    QMetaObject::Connection m_connection;
+    QMetaObject::Connection m_readConnection;
+    int m_chunkSize {defaultChunkSize};
+    qint64 m_totalBytes {defaultTotalBytes};
+    int m_window {defaultWindow};
+    int m_timeout {defaultTimeout};
+    ReadMode m_readMode {ReadAuto};
+    bool m_receiverAutoRead {true};
+    bool m_running {false};
+    QByteArray m_chunk;
+    QByteArray m_readChunk;
+    QVector<qint64> m_sendTimes;
+    int m_latencyIndex {0};
+    qint64 m_latencyTotal {0};
+    qint64 m_startTime {0};
+    qint64 m_startCpu {0};
+    Result m_result;
+    QTimer m_timer;
+
+    void sendChunks();
+    void finish(bool timedOut);
+
+private slots:
+    void receiver_bytesRead(qint64 count);
+    void receiver_readyRead();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_BENCHMARK_H
@@ -0,0 +1,81 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_ENUMERATOR_H
+#define COM_PORT_ENUMERATOR_H
+
+#include <QObject>
+#include <QList>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QMutex>
+#include <QtSerialPort/QSerialPortInfo>
+#include <atomic>
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Shared cache of QSerialPortInfo::availablePorts(). The system is enumerated
+// on a worker thread, so readers never block; portsChanged() reports the
+// difference after each refresh.
+//==============================================================================
+class ComPortEnumerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ComPortEnumerator(QObject *parent = nullptr);
+    ~ComPortEnumerator();
+    static ComPortEnumerator *instance();
+    QList<QSerialPortInfo> ports() const;
+    QStringList portNames() const;
+    bool contains(const QString &portName) const;
+    bool isReady() const;
+    void refreshNow();
+    int refreshInterval() const;
+    void setRefreshInterval(int msec);
+
+signals:
+    void portsChanged(const QStringList &added, const QStringList &removed);
+
+public slots:
+    void refresh();
+
+private:
+    mutable QMutex m_mutex;
+    QList<QSerialPortInfo> m_ports;
+    QStringList m_portNames;
+    bool m_ready {false};
+    QThread m_thread;
+    QObject *m_worker {nullptr};
+    QTimer m_timer;
+    std::atomic<bool> m_refreshPending {false};
+
+    void update(const QList<QSerialPortInfo> &ports);
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_ENUMERATOR_H
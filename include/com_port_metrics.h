@@ -0,0 +1,105 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_METRICS_H
+#define COM_PORT_METRICS_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <QJsonObject>
+#include <atomic>
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Traffic counters of one ComPort. Updates and snapshot() use relaxed atomics
+// only, so a snapshot can be taken from any thread while the port is busy.
+// Rates are averaged over the last rateWindow complete seconds; latencies of
+// the same window (plus the running second) are kept in a histogram of
+// power-of-two microsecond buckets.
+//==============================================================================
+class ComPortMetrics
+{
+    Q_DISABLE_COPY(ComPortMetrics)
+
+public:
+    static const int rateWindow {10};
+    static const int latencyBuckets {32};
+
+    struct Snapshot {
+        quint64 bytesIn {0};
+        quint64 bytesOut {0};
+        quint64 chunksIn {0};
+        quint64 chunksOut {0};
+        quint64 readCalls {0};
+        quint64 errors {0};
+        quint64 bytesDropped {0};
+        quint64 xonEvents {0};
+        quint64 xoffEvents {0};
+        qint64 maxBacklog {0};
+        double rateIn {0.0};
+        double rateOut {0.0};
+        QVector<quint64> latencyHistogram;
+        qint64 latencyPercentile(double percentile) const;
+        QJsonObject toJson() const;
+    };
+
+    ComPortMetrics();
+    void addReceived(qint64 count);
+    void addSent(qint64 count);
+    void addReadCall();
+    void addError();
+    void addDropped(qint64 count);
+    void addFlowEvent(bool xon);
+    void updateBacklog(qint64 backlog);
+    void addLatency(qint64 usec);
+    Snapshot snapshot() const;
+    void reset();
+
+private:
+    struct RateSlot {
+        std::atomic<qint64> second {-1};
+        std::atomic<quint64> bytesIn {0};
+        std::atomic<quint64> bytesOut {0};
+        std::atomic<quint64> latency[latencyBuckets];
+    };
+
+    std::atomic<quint64> m_bytesIn {0};
+    std::atomic<quint64> m_bytesOut {0};
+    std::atomic<quint64> m_chunksIn {0};
+    std::atomic<quint64> m_chunksOut {0};
+    std::atomic<quint64> m_readCalls {0};
+    std::atomic<quint64> m_errors {0};
+    std::atomic<quint64> m_bytesDropped {0};
+    std::atomic<quint64> m_xonEvents {0};
+    std::atomic<quint64> m_xoffEvents {0};
+    std::atomic<qint64> m_maxBacklog {0};
+    RateSlot m_rateSlots[rateWindow + 1];
+
+    RateSlot &rateSlot(qint64 second);
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_METRICS_H
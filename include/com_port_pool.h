@@ -0,0 +1,105 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_POOL_H
+#define COM_PORT_POOL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+#include <functional>
+
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Many ComPorts on a few shared I/O threads. An I/O thread that puts data
+// into a port's ring buffer wakes the owner thread once for all ports with
+// new data; the chunks read then go to the batch callback together. A batch
+// interval above 0 holds the first notification back that long to collect
+// more ports per batch. Nothing runs while the lines are idle.
+//==============================================================================
+class ComPortPool : public QObject
+{
+    Q_OBJECT
+
+    const int defaultBatchInterval {0};
+
+public:
+    struct Chunk {
+        int port {-1};
+        QByteArray data;
+    };
+
+    struct PortCounters {
+        qint64 bytesRead {0};
+        qint64 bytesWritten {0};
+        quint64 chunks {0};
+        quint64 errors {0};
+        qint64 ringBufferFill {0};
+        qint64 ringBufferHighWater {0};
+        quint64 ringBufferOverflow {0};
+        quint64 ringBufferDropped {0};
+    };
+
+    typedef std::function<void(const QVector<Chunk> &batch)> BatchCallback;
+
+    explicit ComPortPool(int threadCount = 2, QObject *parent = nullptr);
+    ~ComPortPool();
+    int threadCount() const;
+    int portCount() const;
+    int addPort(const QString &portName);
+    ComPort *port(int index) const;
+    bool openAll(bool readOnly = false);
+    void closeAll();
+    int batchInterval() const;
+    void setBatchInterval(int msec);
+    void setBatchCallback(const BatchCallback &callback);
+    PortCounters counters(int index) const;
+    PortCounters totalCounters() const;
+    void resetCounters();
+
+private:
+    QVector<QThread*> m_threads;
+    QVector<ComPort*> m_ports;
+    QVector<PortCounters> m_counters;
+    QVector<Chunk> m_batch;
+    BatchCallback m_callback;
+    QTimer m_timer;
+    std::atomic<bool> m_deliveryPending {false};
+
+    void notifyDelivery();
+    void deliver();
+
+private slots:
+    void timer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_POOL_H
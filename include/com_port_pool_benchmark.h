@@ -0,0 +1,123 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_POOL_BENCHMARK_H
+#define COM_PORT_POOL_BENCHMARK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QTimer>
+
+#include "com_port_pool.h"
+#include "virtual_serial_link.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Stress run of ComPortPool: portCount() pty ports (VirtualSerialLink pairs,
+// unpaced) are served by threadCount() pool threads, every port writes one
+// chunk each sendInterval() ms to its peer for duration() ms. CPU load is
+// process time over wall time in percent of one core, sampled every second,
+// so the link bridge threads are part of it.
+class ComPortPoolBenchmark : public QObject
+{
+    Q_OBJECT
+
+    const int defaultPortCount {64};
+    const int defaultThreadCount {2};
+    const int defaultDuration {10000};
+    const int defaultChunkSize {64};
+    const int defaultSendInterval {10};
+    const int sampleInterval {1000};
+
+public:
+    struct Result {
+        int ports {0};
+        int threads {0};
+        qint64 elapsed {0};
+        qint64 bytesWritten {0};
+        qint64 bytesRead {0};
+        double throughput {0.0};
+        double cpuLoadAverage {0.0};
+        double cpuLoadMin {0.0};
+        double cpuLoadMax {0.0};
+        quint64 errors {0};
+        quint64 bytesDropped {0};
+    };
+
+    explicit ComPortPoolBenchmark(QObject *parent = nullptr);
+    ~ComPortPoolBenchmark();
+    int portCount() const;
+    void setPortCount(int portCount);
+    int threadCount() const;
+    void setThreadCount(int threadCount);
+    int duration() const;
+    void setDuration(int msec);
+    int chunkSize() const;
+    void setChunkSize(int chunkSize);
+    int sendInterval() const;
+    void setSendInterval(int msec);
+    QString lastError() const;
+    bool isRunning() const;
+    Result result() const;
+
+signals:
+    void finished(const nayk::ComPortPoolBenchmark::Result &result);
+
+public slots:
+    bool start();
+    void stop();
+
+private:
+    int m_portCount {defaultPortCount};
+    int m_threadCount {defaultThreadCount};
+    int m_duration {defaultDuration};
+    int m_chunkSize {defaultChunkSize};
+    int m_sendInterval {defaultSendInterval};
+    QString m_lastError {""};
+    QVector<VirtualSerialLink*> m_links;
+    ComPortPool *m_pool {nullptr};
+    QByteArray m_chunk;
+    QTimer m_sendTimer;
+    QTimer m_sampleTimer;
+    QTimer m_durationTimer;
+    bool m_running {false};
+    qint64 m_startTime {0};
+    qint64 m_startCpu {0};
+    qint64 m_sampleTime {0};
+    qint64 m_sampleCpu {0};
+    int m_samples {0};
+    Result m_result;
+
+    void release();
+
+private slots:
+    void sendTimer_timeout();
+    void sampleTimer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_POOL_BENCHMARK_H
@@ -0,0 +1,106 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_REPLAY_H
+#define COM_REPLAY_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+
+#include "com_capture.h"
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+class ComReplay : public QObject
+{
+    Q_OBJECT
+
+    const int defaultBlockSize {262144};
+    const int batchSize {1024};
+
+public:
+    struct Record {
+        qint64 timestamp {0};
+        quint16 portId {0};
+        ComCapture::Direction direction {ComCapture::DirectionRx};
+        QByteArray data;
+    };
+
+    explicit ComReplay(QObject *parent = nullptr);
+    QString lastError() const;
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    bool isRunning() const;
+    double speed() const;
+    void setSpeed(double speed);
+    int portFilter() const;
+    void setPortFilter(int portId);
+    ComPort *target() const;
+    void setTarget(ComPort *port);
+    quint64 recordCount() const;
+    bool readRecord(Record &record);
+    quint64 replayAll();
+
+signals:
+    void received(const QByteArray &bytes, qint64 timestamp, quint16 portId);
+    void transmitted(const QByteArray &bytes, qint64 timestamp, quint16 portId);
+    void finished();
+
+public slots:
+    void start();
+    void stop();
+
+private:
+    QFile m_file;
+    QString m_lastError {""};
+    QByteArray m_buffer;
+    int m_bufferPos {0};
+    double m_speed {1.0};
+    int m_portFilter {-1};
+    QPointer<ComPort> m_target;
+    quint64 m_recordCount {0};
+    Record m_pending;
+    bool m_hasPending {false};
+    qint64 m_firstTimestamp {0};
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+
+    bool fill(int size);
+    void dispatch(const Record &record);
+
+private slots:
+    void timer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_REPLAY_H
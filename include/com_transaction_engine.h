@@ -0,0 +1,129 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_TRANSACTION_ENGINE_H
+#define COM_TRANSACTION_ENGINE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <functional>
+
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+class ComTransactionEngine : public QObject
+{
+    Q_OBJECT
+
+    const int defaultTimeout {1000};
+
+public:
+    typedef std::function<int(const QByteArray &data)> ResponseMatcher;
+    typedef std::function<void(int id, bool ok, const QByteArray &response)> Callback;
+
+    explicit ComTransactionEngine(ComPort *port = nullptr, QObject *parent = nullptr);
+    ComPort *port() const;
+    void setPort(ComPort *port);
+    int submit(const QByteArray &request, const ResponseMatcher &matcher,
+               const Callback &callback = Callback(), int timeout = -1,
+               int slaveId = 0, int priority = 0, int retries = 0);
+    bool cancel(int id);
+    void clear();
+    int slavePriority(int slaveId) const;
+    void setSlavePriority(int slaveId, int priority);
+    int pendingCount() const;
+    bool isBusy() const;
+    double busUtilization() const;
+    qint64 rttMin() const;
+    qint64 rttMax() const;
+    qint64 rttAverage() const;
+    quint64 completedCount() const;
+    quint64 failedCount() const;
+    quint64 timeoutCount() const;
+    quint64 retryCount() const;
+    void resetStatistics();
+    static ResponseMatcher fixedLengthMatcher(int length);
+
+signals:
+    void finished(int id, bool ok, const QByteArray &response);
+    void idle();
+
+private:
+    struct Transaction {
+        int id {0};
+        quint64 sequence {0};
+        QByteArray request;
+        ResponseMatcher matcher;
+        Callback callback;
+        int timeout {0};
+        int slaveId {0};
+        int priority {0};
+        int retries {0};
+    };
+
+    QPointer<ComPort> m_port;
+    QList<Transaction> m_queue;
+    Transaction m_current;
+    bool m_active {false};
+    bool m_completing {false};
+    bool m_starting {false};
+    int m_lastId {0};
+    quint64 m_sequence {0};
+    QMap<int, int> m_slavePriority;
+    QByteArray m_rxBuffer;
+    int m_rxSlaveId {0};
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_sentTime {0};
+    qint64 m_statStart {0};
+    qint64 m_busyTime {0};
+    qint64 m_rttMin {0};
+    qint64 m_rttMax {0};
+    qint64 m_rttTotal {0};
+    quint64 m_completedCount {0};
+    quint64 m_failedCount {0};
+    quint64 m_timeoutCount {0};
+    quint64 m_retryCount {0};
+
+    void send();
+    void matchResponse();
+    void retryOrFail(const QByteArray &response);
+    void complete(bool ok, const QByteArray &response);
+
+private slots:
+    void startNext();
+    void port_received(const QByteArray &bytes);
+    void timer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_TRANSACTION_ENGINE_H
@@ -33,6 +33,7 @@
 #include <QStringList>
 
 #include "Log"
+#include "LogSearch"
 
 namespace nayk { //=============================================================
 
@@ -50,6 +51,9 @@ public:
     bool openLogDirButtonVisible() const;
     void setOpenLogDirButtonVisible(bool openLogDirButtonVisible);
     static QString highlight(const QString &text, bool dark = false);
+    bool openLogFile(const QString &fileName);
+    void closeLogFile();
+    bool isLogFileOpen() const;
 
 signals:
     void openLogDirButtonClicked();
@@ -65,10 +69,12 @@ private:
     QTextEdit *textEditLog {nullptr};
     QLineEdit *lineEditFilter {nullptr};
     QPushButton *pushButtonOpenLogDir {nullptr};
+    LogSearch *logSearch {nullptr};
 
     void initializeDialog();
     void checkBlockCount();
     void applyFilter();
+    void searchLogFile();
 
 public slots:
     void saveToLog(const QString &text, Log::LogType logType = Log::LogInfo);
@@ -78,6 +84,7 @@ private slots:
     void lineEditFilter_editingFinished();
     void pushButtonClear_clicked();
     void checkBoxDark_toggled(bool checked);
+    void logSearch_matched(const QStringList &lines);
 };
 //==============================================================================
 
@@ -0,0 +1,129 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QPointer>
+
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// selfTest() feeds delimited and length-field streams through a ComPort,
+// split at every chunk size, and returns false with the first mismatch.
+//==============================================================================
+class FrameAssembler : public QObject
+{
+    Q_OBJECT
+
+    const int defaultMaxFrameSize {65536};
+    const int defaultInterCharTimeout {5};
+
+public:
+    enum FramingMode {
+        DelimiterFraming = 0,
+        LengthFieldFraming,
+        TimeoutFraming
+    };
+    Q_ENUM(FramingMode)
+
+    explicit FrameAssembler(QObject *parent = nullptr);
+    explicit FrameAssembler(FramingMode framingMode, QObject *parent = nullptr);
+    FramingMode framingMode() const;
+    void setFramingMode(FramingMode framingMode);
+    QByteArray startDelimiter() const;
+    void setStartDelimiter(const QByteArray &startDelimiter);
+    QByteArray endDelimiter() const;
+    void setEndDelimiter(const QByteArray &endDelimiter);
+    bool includeDelimiters() const;
+    void setIncludeDelimiters(bool includeDelimiters);
+    void setLengthField(int offset, int size, bool bigEndian = true, int adjustment = 0);
+    int lengthFieldOffset() const;
+    int lengthFieldSize() const;
+    bool lengthFieldBigEndian() const;
+    int lengthAdjustment() const;
+    int interCharTimeout() const;
+    void setInterCharTimeout(int msec);
+    int maxFrameSize() const;
+    void setMaxFrameSize(int maxFrameSize);
+    int pendingBytes() const;
+    quint64 frameCount() const;
+    quint64 discardedBytes() const;
+    void attach(ComPort *port);
+    void detach();
+    static int silenceInterval(qint32 baudRate, int dataBits = 8, bool parity = false,
+                               int stopBits = 1, double chars = 3.5);
+    static bool selfTest(QString *errorString = nullptr);
+
+signals:
+    void frameReady(const QByteArray &frame);
+    void bytesDiscarded(qint64 count);
+
+public slots:
+    void append(const QByteArray &bytes);
+    void append(const char *data, qint64 size);
+    void clear();
+    void flush();
+
+private:
+    FramingMode m_framingMode {DelimiterFraming};
+    QByteArray m_startDelimiter;
+    QByteArray m_endDelimiter {"\n"};
+    bool m_includeDelimiters {true};
+    int m_lengthOffset {0};
+    int m_lengthSize {1};
+    bool m_lengthBigEndian {true};
+    int m_lengthAdjustment {0};
+    int m_interCharTimeout {defaultInterCharTimeout};
+    int m_maxFrameSize {defaultMaxFrameSize};
+    QByteArray m_buffer;
+    int m_head {0};
+    int m_scanPos {0};
+    int m_frameStart {-1};
+    quint64 m_frameCount {0};
+    quint64 m_discardedBytes {0};
+    QTimer m_timer;
+    QElapsedTimer m_lastRxTimer;
+    QPointer<ComPort> m_port;
+    QMetaObject::Connection m_portConnection;
+
+    void extractDelimited();
+    void extractLengthField();
+    void emitFrame(int from, int size);
+    void discard(int count);
+    void compact();
+
+private slots:
+    void timer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // FRAME_ASSEMBLER_H
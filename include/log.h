@@ -29,6 +29,16 @@
 #include <QDateTime>
 #include <QFile>
 #include <QTextStream>
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <atomic>
 
 namespace nayk { //=============================================================
 
@@ -37,7 +47,7 @@ class Log : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(bool debugSave READ debugSave WRITE setDebugSave NOTIFY debugSaveChanged)
-    Q_PROPERTY(QString logFileName READ logFileName CONSTANT)
+    Q_PROPERTY(QString logFileName READ logFileName)
     Q_PROPERTY(QString logDir READ logDir CONSTANT)
     Q_PROPERTY(QString lastError READ lastError NOTIFY error)
 
@@ -63,26 +73,206 @@ public:
     ~Log();
     void setDebugSave(bool enable = true);
     bool debugSave() const;
+    bool asyncMode() const;
+    void setAsyncMode(bool enable = true);
+    int flushInterval() const;
+    void setFlushInterval(int msec);
+    qint64 maxFileSize() const;
+    void setMaxFileSize(qint64 bytes);
+    int rotationInterval() const;
+    void setRotationInterval(int sec);
+    int maxFiles() const;
+    int maxAge() const;
+    qint64 maxTotalSize() const;
+    // Retention counts generations: a rotated .log (or .log.gz) together
+    // with its .nlog and .nidx. Only generated timestamp names are removed
+    void setRetention(int maxFiles, int maxAgeDays = 0, qint64 maxTotalSize = 0);
+    bool compressRotated() const;
+    void setCompressRotated(bool enable = true);
+    // Rotates a small log with compression and retention in a new subfolder
+    // of logDir and checks what is left; false with the first mismatch
+    static bool selfTest(const QString &logDir, QString *errorString = nullptr);
     QString logDir() const;
     QString logFileName() const;
     QString lastError() const;
     static QString getLogTypeStr(LogType logType);
     static QString getLogPrefix(LogType logType,
                                 const QDateTime &date = QDateTime::currentDateTime());
+    // Reads back a prefix of getLogPrefix() from a UTF-8 text log line:
+    // the type (LogOther if untagged) and the time of day in msecs (-1 if
+    // absent). False if the line carries neither
+    static bool parseLogPrefix(const char *line, int length, LogType &logType, int &msecs);
+    static QDateTime currentTime();
+    bool binaryLog() const;
+    bool setBinaryLog(bool enable = true);
+    // With the binary log open the text file can be left out, only the
+    // .nlog is written then; it is written again once the binary log closes
+    bool textLog() const;
+    bool setTextLog(bool enable = true);
+    QString binaryFileName() const;
+    static QByteArray binaryMagic();
+    static QByteArray indexMagic();
+    int indexRecords() const;
+    int indexBytes() const;
+    void setIndexInterval(int records, int bytes);
+
+    // Rate limits are token buckets (burst 0 = one second worth of messages),
+    // sampling keeps 1 of every N messages; both apply per type and per source.
+    // Suppressed messages are only counted, see limitStatistics()
+    void setRateLimit(LogType logType, double perSecond, int burst = 0);
+    void setSampling(LogType logType, int oneOf);
+    void setSourceRateLimit(quint16 sourceId, double perSecond, int burst = 0);
+    void setSourceSampling(quint16 sourceId, int oneOf);
+    bool suppressDuplicates() const;
+    void setSuppressDuplicates(bool enable = true);
+    void clearRateLimits();
+    quint64 suppressedCount(LogType logType) const;
+    quint64 sourceSuppressedCount(quint16 sourceId) const;
+    quint64 duplicateCount() const;
+    QJsonObject limitStatistics() const;
+    void resetLimitStatistics();
+
+    // Binary log (.nlog) written next to the text log: 8 byte header
+    // "NLOG" + quint16 version + quint16 reserved, then per message a 20 byte
+    // little-endian header (qint64 msecs since epoch, qint16 UTC offset in
+    // minutes, quint16 source id, quint8 log type, 3 reserved bytes,
+    // quint32 size) followed by the UTF-8 text
+    static const quint16 binaryFormatVersion {1};
+    static const int binaryHeaderSize {8};
+    static const int binaryRecordHeaderSize {20};
+
+    // Sparse index (.nidx) of the binary log: 8 byte header "NIDX" +
+    // quint16 version + quint16 reserved, then per block of records a 40 byte
+    // little-endian entry (qint64 offset in .nlog, quint32 size, quint32
+    // record count, qint64 first and qint64 last timestamp, quint32 mask of
+    // 1 << LogType present in the block, quint32 reserved)
+    static const int indexEntrySize {40};
     static LogType strToLogType(const QString &typeStr);
 
 private:
+    // Queued message of the async writer, linked newest first
+    struct Record {
+        Record *next {nullptr};
+        qint64 order {0};
+        QDateTime time;
+        LogType logType {LogInfo};
+        quint16 sourceId {0};
+        QString text;
+    };
+
+    // Token bucket with optional 1-of-N sampling
+    struct Limit {
+        double rate {0.0};
+        double burst {0.0};
+        double tokens {0.0};
+        qint64 last {0};
+        int sampling {1};
+        quint64 sampleCounter {0};
+        quint64 suppressed {0};
+    };
+
+    // Duplicate tracking per source and type, the hash rejects most
+    // differing messages before the previous text is compared
+    struct Repeat {
+        uint hash {0};
+        QString text;
+        quint64 count {0};
+        bool seen {false};
+    };
+
+    // Signal raised while m_mutex is held, emitted once it is released
+    enum Notice {
+        NoticeOpen = 0,
+        NoticeClose,
+        NoticeError,
+        NoticeWrite
+    };
+
+    // Per-thread staging queue, only its owner thread pushes to it
+    struct Stage {
+        Stage *next {nullptr};
+        Qt::HANDLE threadId {nullptr};
+        std::atomic<Record*> queue {nullptr};
+        std::atomic<bool> busy {false};
+    };
+
     const QString defaultLogDirName {"log"};
+    const int defaultFlushInterval {500};
     QDateTime m_startTime;
     QString m_fileName {""};
     QString m_logDir {""};
     QFile m_file;
     QTextStream m_stream;
+    QFile m_binaryFile;
+    QByteArray m_binaryBlock;
+    qint64 m_binaryOffset {0};
+    QFile m_indexFile;
+    QByteArray m_indexBlock;
+    int m_indexRecords {1024};
+    int m_indexBytes {65536};
+    qint64 m_blockOffset {-1};
+    qint64 m_blockFirst {0};
+    qint64 m_blockLast {0};
+    quint32 m_blockCount {0};
+    quint32 m_blockMask {0};
     QString m_lastError {""};
-    bool m_dbgSave {true};
+    std::atomic<bool> m_dbgSave {true};
+    mutable QMutex m_mutex;
+    QVector<QPair<Notice, QString>> m_notices;
+    qint64 m_maxFileSize {0};
+    int m_rotationInterval {0};
+    qint64 m_nextRotation {0};
+    int m_maxFiles {0};
+    int m_maxAge {0};
+    qint64 m_maxTotalSize {0};
+    bool m_compressRotated {false};
+    bool m_textLog {true};
+    const quint64 m_instanceId {nextInstanceId()};
+    std::atomic<Stage*> m_stages {nullptr};
+    mutable QMutex m_limitMutex;
+    std::atomic<bool> m_limiting {false};
+    Limit m_typeLimits[LogOther + 1];
+    QHash<quint16, Limit> m_sourceLimits;
+    QHash<quint32, Repeat> m_repeats;
+    bool m_suppressDuplicates {false};
+    quint64 m_duplicateCount {0};
+    QElapsedTimer m_limitClock;
+    std::atomic<bool> m_async {false};
+    std::atomic<bool> m_writerStop {false};
+    std::atomic<bool> m_writerFailed {false};
+    std::atomic<int> m_flushInterval {defaultFlushInterval};
+    QSemaphore m_wake;
+    std::atomic<quint64> m_flushRequests {0};
+    quint64 m_flushedRequests {0};
+    QMutex m_flushMutex;
+    QWaitCondition m_flushed;
+    QThread *m_writerThread {nullptr};
     bool writeFirstLine();
     bool writeLastLine();
     void startLog(const QString &fileName = QString());
+    void writeMessage(const QDateTime &now, quint16 sourceId, const QString &text, LogType logType);
+    bool admit(quint16 sourceId, const QString &text, LogType logType, QString &repeatNote);
+    void updateLimiting();
+    void flushRepeats();
+    void writeLines(const QDateTime &time, const QString &text, LogType logType, quint16 sourceId);
+    bool openBinaryFile();
+    void closeBinaryFile();
+    void closeIndexBlock();
+    bool flushStream();
+    bool writesText() const;
+    void postNotice(Notice notice, const QString &text);
+    void emitNotices();
+    void scheduleRotation(const QDateTime &now);
+    void rotateIfNeeded(const QDateTime &now);
+    void rotateFile(const QDateTime &now);
+    static quint64 nextInstanceId();
+    Stage *currentStage();
+    QVector<Record*> takeRecords();
+    bool writeRecords(const QVector<Record*> &records);
+    void writerLoop();
+    void stopWriter();
+    void waitForFlush(quint64 request);
+    void releaseFlush(quint64 request);
 
 signals:
     void openFile(const QString &fileName);
@@ -93,6 +283,9 @@ signals:
 
 public slots:
     void saveToLog(const QString &text, LogType logType = LogInfo);
+    void saveSourceToLog(quint16 sourceId, const QString &text, LogType logType = LogInfo);
+    void flush();
+    void rotate();
 };
 //==============================================================================
 
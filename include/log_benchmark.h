@@ -0,0 +1,96 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef LOG_BENCHMARK_H
+#define LOG_BENCHMARK_H
+
+#include <QPointer>
+
+#include "log.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Contention benchmark of the Log front end: several producer threads call
+// saveToLog() concurrently, run() blocks until all of them are done.
+// runFormat() compares per-line prefix formatting with the former
+// QDateTime::toString() based one, without any file I/O. runIndex() writes
+// a synthetic binary log of the given size and times error and time-window
+// queries with and without the sparse index
+class LogBenchmark
+{
+    const int defaultThreads {8};
+    const int defaultMessages {100000};
+    const int defaultMessageSize {64};
+
+public:
+    struct Result {
+        int threads {0};
+        qint64 messages {0};
+        qint64 elapsed {0};
+        double messagesPerSecond {0.0};
+        qint64 callAverage {0};
+        qint64 callMax {0};
+    };
+
+    struct FormatResult {
+        qint64 lines {0};
+        double legacyLinesPerSecond {0.0};
+        double linesPerSecond {0.0};
+    };
+
+    struct IndexResult {
+        qint64 fileSize {0};
+        qint64 records {0};
+        qint64 errors {0};
+        qint64 scanTime {0};
+        qint64 indexedTime {0};
+        qint64 windowScanTime {0};
+        qint64 windowIndexedTime {0};
+    };
+
+    explicit LogBenchmark(Log *log = nullptr);
+    Log *log() const;
+    void setLog(Log *log);
+    int threads() const;
+    void setThreads(int threads);
+    int messages() const;
+    void setMessages(int messages);
+    int messageSize() const;
+    void setMessageSize(int messageSize);
+    Result run();
+    FormatResult runFormat(int lines = 1000000) const;
+    IndexResult runIndex(const QString &logDir, qint64 totalBytes = Q_INT64_C(4294967296),
+                         int errorEvery = 100000) const;
+
+private:
+    QPointer<Log> m_log;
+    int m_threads {defaultThreads};
+    int m_messages {defaultMessages};
+    int m_messageSize {defaultMessageSize};
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // LOG_BENCHMARK_H
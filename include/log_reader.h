@@ -0,0 +1,126 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <limits>
+
+#include "log.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Reader of the binary log written by Log::setBinaryLog(). When the .nidx
+// sidecar is present, blocks outside the time range or without any of the
+// filtered log types are skipped without being read.
+// selfTest() writes a binary log into a new subfolder of logDir, reads it
+// back and compares indexed queries with full scans; it returns false with
+// the first record or query that differs
+class LogReader : public QObject
+{
+    Q_OBJECT
+
+    const int defaultBlockSize {262144};
+
+public:
+    struct Record {
+        qint64 timestamp {0};
+        int utcOffset {0};
+        quint16 sourceId {0};
+        Log::LogType logType {Log::LogInfo};
+        QString text;
+        QDateTime time() const;
+        QStringList toText() const;
+    };
+
+    struct IndexEntry {
+        qint64 offset {0};
+        quint32 size {0};
+        quint32 count {0};
+        qint64 first {0};
+        qint64 last {0};
+        quint32 typeMask {0};
+    };
+
+    static const quint32 allTypes {0xFFFFFFFFu};
+
+    explicit LogReader(QObject *parent = nullptr);
+    QString lastError() const;
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    int sourceFilter() const;
+    void setSourceFilter(int sourceId);
+    quint32 typeFilter() const;
+    void setTypeFilter(quint32 mask);
+    qint64 timeFrom() const;
+    qint64 timeTo() const;
+    void setTimeRange(qint64 from, qint64 to);
+    bool useIndex() const;
+    void setUseIndex(bool useIndex);
+    bool hasIndex() const;
+    QVector<IndexEntry> index() const;
+    quint64 recordCount() const;
+    bool rewind();
+    bool seekTime(qint64 timestamp);
+    bool readRecord(Record &record, bool withText = true);
+    QVector<Record> query(qint64 from, qint64 to, quint32 typeMask = allTypes,
+                          int maxRecords = -1);
+    static quint32 typeMask(Log::LogType logType);
+    static bool convertToText(const QString &binaryFileName, const QString &textFileName,
+                              QString *errorString = nullptr);
+    static bool selfTest(const QString &logDir, QString *errorString = nullptr);
+
+private:
+    QFile m_file;
+    QString m_lastError {""};
+    QByteArray m_buffer;
+    int m_bufferPos {0};
+    qint64 m_bufferOffset {0};
+    int m_sourceFilter {-1};
+    quint32 m_typeFilter {allTypes};
+    qint64 m_timeFrom {std::numeric_limits<qint64>::min()};
+    qint64 m_timeTo {std::numeric_limits<qint64>::max()};
+    bool m_useIndex {true};
+    QVector<IndexEntry> m_index;
+    int m_block {0};
+    quint64 m_recordCount {0};
+
+    bool fill(int size);
+    bool seek(qint64 offset);
+    bool loadIndex(const QString &fileName);
+    bool blockMatches(const IndexEntry &entry) const;
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // LOG_READER_H
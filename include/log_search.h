@@ -0,0 +1,140 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef LOG_SEARCH_H
+#define LOG_SEARCH_H
+
+#include <QObject>
+#include <QFile>
+#include <QMap>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTime>
+#include <QVector>
+#include <atomic>
+
+#include "log.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Search over a text log produced by Log. The file is memory-mapped and cut
+// into line-aligned chunks that are filtered on a thread pool; matching
+// lines are emitted chunk by chunk in file order. With maxResults() set the
+// newest matches are kept: chunks are searched from the end of the file and
+// the lines are emitted once, still in file order.
+// selfTest() writes a text log into a new subfolder of logDir and runs the
+// substring, case, type, time and result limit filters over it; it returns
+// false with the first wrong result. It runs a local event loop, so it needs
+// the application object
+class LogSearch : public QObject
+{
+    Q_OBJECT
+
+    const qint64 defaultChunkSize {4194304};
+
+public:
+    static const quint32 allTypes {0xFFFFFFFFu};
+
+    explicit LogSearch(QObject *parent = nullptr);
+    ~LogSearch();
+    QString lastError() const;
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const;
+    qint64 size() const;
+    QString substring() const;
+    Qt::CaseSensitivity caseSensitivity() const;
+    void setSubstring(const QString &substring, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+    QRegularExpression regExp() const;
+    void setRegExp(const QRegularExpression &regExp);
+    quint32 typeFilter() const;
+    void setTypeFilter(quint32 mask);
+    QTime timeFrom() const;
+    QTime timeTo() const;
+    void setTimeRange(const QTime &from, const QTime &to);
+    qint64 chunkSize() const;
+    void setChunkSize(qint64 chunkSize);
+    int maxResults() const;
+    void setMaxResults(int maxResults);
+    int maxThreadCount() const;
+    void setMaxThreadCount(int maxThreadCount);
+    bool isRunning() const;
+    qint64 matchCount() const;
+    static bool selfTest(const QString &logDir, QString *errorString = nullptr);
+
+signals:
+    void matched(const QStringList &lines);
+    void progress(qint64 processed, qint64 total);
+    void finished(qint64 matchCount);
+
+public slots:
+    bool start();
+    void stop();
+
+private:
+    struct Filter {
+        QByteArray substring;
+        QString text;
+        Qt::CaseSensitivity cs {Qt::CaseSensitive};
+        QRegularExpression regExp;
+        quint32 typeMask {allTypes};
+        int timeFrom {-1};
+        int timeTo {-1};
+    };
+
+    QFile m_file;
+    const char *m_data {nullptr};
+    qint64 m_size {0};
+    QString m_lastError {""};
+    QString m_substring {""};
+    Qt::CaseSensitivity m_cs {Qt::CaseSensitive};
+    QRegularExpression m_regExp;
+    quint32 m_typeFilter {allTypes};
+    QTime m_timeFrom;
+    QTime m_timeTo;
+    qint64 m_chunkSize {defaultChunkSize};
+    int m_maxResults {-1};
+    QThreadPool m_pool;
+    std::atomic<bool> m_cancel {false};
+    quint64 m_generation {0};
+    bool m_running {false};
+    QVector<qint64> m_chunks;
+    QMap<int, QStringList> m_pending;
+    QList<QStringList> m_tail;
+    int m_nextChunk {0};
+    qint64 m_matchCount {0};
+
+    void chunkDone(quint64 generation, int index, const QStringList &lines);
+    void tailChunkDone();
+    void finish();
+    static QStringList searchChunk(const char *data, qint64 size, const Filter &filter,
+                                   const std::atomic<bool> &cancel);
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // LOG_SEARCH_H
@@ -0,0 +1,128 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef NATIVE_SERIAL_PORT_H
+#define NATIVE_SERIAL_PORT_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QThread>
+#include <QtSerialPort/QSerialPort>
+#include <atomic>
+#include <functional>
+
+#include "ring_buffer.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+class NativeSerialPort
+{
+    Q_DISABLE_COPY(NativeSerialPort)
+
+    const qint64 defaultWriteBufferSize {1048576};
+
+public:
+    typedef std::function<void()> ReadyReadHandler;
+    typedef std::function<void(const QString &errorString)> ErrorHandler;
+
+    explicit NativeSerialPort(RingBuffer *ringBuffer);
+    ~NativeSerialPort();
+    QString portName() const;
+    void setPortName(const QString &portName);
+    QString errorString() const;
+    qint32 baudRate() const;
+    bool setBaudRate(qint32 baudRate);
+    QSerialPort::DataBits dataBits() const;
+    bool setDataBits(QSerialPort::DataBits dataBits);
+    QSerialPort::StopBits stopBits() const;
+    bool setStopBits(QSerialPort::StopBits stopBits);
+    QSerialPort::Parity parity() const;
+    bool setParity(QSerialPort::Parity parity);
+    QSerialPort::FlowControl flowControl() const;
+    bool setFlowControl(QSerialPort::FlowControl flowControl);
+    bool setSettings(qint32 baudRate, QSerialPort::DataBits dataBits,
+                     QSerialPort::StopBits stopBits, QSerialPort::Parity parity,
+                     QSerialPort::FlowControl flowControl);
+    int readMinimum() const;
+    bool setReadMinimum(int readMinimum);
+    int readTimeout() const;
+    bool setReadTimeout(int deciseconds);
+    bool lowLatency() const;
+    void setLowLatency(bool lowLatency);
+    qint64 writeBufferSize() const;
+    void setWriteBufferSize(qint64 size);
+    qint64 bytesToWrite() const;
+    void setReadLimit(qint64 limit, bool block);
+    quint64 limitDropped() const;
+    void resume();
+    void setReadyReadHandler(const ReadyReadHandler &handler);
+    void setErrorHandler(const ErrorHandler &handler);
+    bool open(bool readOnly = false);
+    void close();
+    bool isOpen() const;
+    bool isRequestToSend();
+    qint64 write(const char *data, qint64 size);
+    bool applySettings();
+
+private:
+    RingBuffer *m_ringBuffer {nullptr};
+    QString m_portName {""};
+    QString m_errorString {""};
+    qint32 m_baudRate {9600};
+    QSerialPort::DataBits m_dataBits {QSerialPort::Data8};
+    QSerialPort::StopBits m_stopBits {QSerialPort::OneStop};
+    QSerialPort::Parity m_parity {QSerialPort::NoParity};
+    QSerialPort::FlowControl m_flowControl {QSerialPort::NoFlowControl};
+    int m_readMinimum {1};
+    int m_readTimeout {0};
+    bool m_lowLatency {true};
+    qint64 m_writeBufferSize {defaultWriteBufferSize};
+    int m_fd {-1};
+    int m_epollFd {-1};
+    int m_wakeFd {-1};
+    QThread *m_thread {nullptr};
+    std::atomic<bool> m_stop {false};
+    std::atomic<qint64> m_readLimit {0};
+    std::atomic<bool> m_blockOnLimit {false};
+    std::atomic<bool> m_paused {false};
+    std::atomic<quint64> m_limitDropped {0};
+    mutable QMutex m_txMutex;
+    QByteArray m_txBuffer;
+    ReadyReadHandler m_readyReadHandler;
+    ErrorHandler m_errorHandler;
+
+    bool setError(const QString &errorString);
+    void run();
+    void pause();
+    bool readAvailable();
+    bool writePending();
+    void updateEvents();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // NATIVE_SERIAL_PORT_H
@@ -0,0 +1,92 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <vector>
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Fixed-capacity single-producer/single-consumer byte queue.
+// write()/writeSpace()/commitWrite()/addOverflow() are called by one producer
+// thread only, read()/skip() by one consumer thread only; no locks are taken.
+// commitWrite() can stamp the newest byte with a producer-side time, which the
+// consumer gets back from writeTimestamp().
+// selfTest() runs a small buffer through every wrap offset with both read
+// overloads and checks order, sizes and overflow statistics; it returns
+// false and describes the first mismatch.
+//==============================================================================
+class RingBuffer
+{
+    Q_DISABLE_COPY(RingBuffer)
+
+public:
+    static const qint64 defaultCapacity {65536};
+
+    explicit RingBuffer(qint64 capacity = defaultCapacity);
+    qint64 capacity() const;
+    void setCapacity(qint64 capacity);
+    void clear();
+    bool isEmpty() const;
+    qint64 size() const;
+    qint64 freeSpace() const;
+    qint64 highWater() const;
+    quint64 overflowCount() const;
+    quint64 droppedBytes() const;
+    void resetStatistics();
+
+    qint64 write(const char *data, qint64 size);
+    qint64 write(const char *data, qint64 size, qint64 timestamp);
+    qint64 writeSpace(char **data) const;
+    void commitWrite(qint64 count);
+    void commitWrite(qint64 count, qint64 timestamp);
+    qint64 writeTimestamp() const;
+    void addOverflow(qint64 droppedCount);
+
+    qint64 read(char *data, qint64 maxSize);
+    qint64 read(QByteArray &buffer, qint64 maxSize = -1);
+    qint64 skip(qint64 maxSize);
+
+    static bool selfTest(QString *errorString = nullptr);
+
+private:
+    std::vector<char> m_data;
+    quint64 m_mask {0};
+    alignas(64) std::atomic<quint64> m_head {0};
+    alignas(64) std::atomic<quint64> m_tail {0};
+    alignas(64) std::atomic<qint64> m_highWater {0};
+    std::atomic<qint64> m_writeTimestamp {0};
+    std::atomic<quint64> m_overflowCount {0};
+    std::atomic<quint64> m_droppedBytes {0};
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // RING_BUFFER_H
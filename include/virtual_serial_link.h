@@ -0,0 +1,128 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef VIRTUAL_SERIAL_LINK_H
+#define VIRTUAL_SERIAL_LINK_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QTimer>
+#include <QThread>
+#include <QPointer>
+#include <QtSerialPort/QSerialPort>
+#include <atomic>
+
+#include "com_port.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// Simulated null-modem cable. attach() links two ComPorts in process through
+// ComPort::BackendVirtual and paces each direction by the character time of
+// the sending port. openPty() bridges two pseudo terminals instead, so any
+// backend can open firstPortName()/secondPortName(); the bridge paces by the
+// format given to setLineFormat(). Both modes add latency() and inject byte
+// drops and bit errors at the configured rates.
+//==============================================================================
+class VirtualSerialLink : public QObject
+{
+    Q_OBJECT
+
+    const int tickInterval {1};
+    const int ptyBufferSize {4096};
+
+public:
+    explicit VirtualSerialLink(QObject *parent = nullptr);
+    ~VirtualSerialLink();
+    QString lastError() const;
+    bool attach(ComPort *first, ComPort *second);
+    void detach();
+    bool openPty();
+    void closePty();
+    bool isPtyOpen() const;
+    QString firstPortName() const;
+    QString secondPortName() const;
+    bool pacing() const;
+    void setPacing(bool pacing);
+    void setLineFormat(qint32 baudRate,
+                       QSerialPort::DataBits dataBits = QSerialPort::Data8,
+                       QSerialPort::Parity parity = QSerialPort::NoParity,
+                       QSerialPort::StopBits stopBits = QSerialPort::OneStop);
+    int latency() const;
+    void setLatency(int usec);
+    double errorRate() const;
+    void setErrorRate(double errorRate);
+    double dropRate() const;
+    void setDropRate(double dropRate);
+    quint64 bytesTransferred() const;
+    quint64 bytesCorrupted() const;
+    quint64 bytesDropped() const;
+    void resetCounters();
+
+private:
+    struct Transfer {
+        QPointer<ComPort> port;
+        qint64 start {0};
+        qint64 charTime {0};
+        QByteArray data;
+        int delivered {0};
+    };
+
+    QString m_lastError {""};
+    QPointer<ComPort> m_first;
+    QPointer<ComPort> m_second;
+    ComPort::Backend m_previousBackend[2] {ComPort::BackendQt, ComPort::BackendQt};
+    QVector<Transfer> m_transfers;
+    qint64 m_lineFree[2] {0, 0};
+    QTimer m_timer;
+    std::atomic<bool> m_pacing {true};
+    std::atomic<qint64> m_ptyCharTime {0};
+    std::atomic<int> m_latency {0};
+    std::atomic<double> m_errorRate {0.0};
+    std::atomic<double> m_dropRate {0.0};
+    std::atomic<quint64> m_bytesTransferred {0};
+    std::atomic<quint64> m_bytesCorrupted {0};
+    std::atomic<quint64> m_bytesDropped {0};
+    int m_masterFd[2] {-1, -1};
+    int m_slaveFd[2] {-1, -1};
+    QString m_slaveName[2];
+    int m_wakeFd {-1};
+    QThread *m_thread {nullptr};
+    std::atomic<bool> m_stop {false};
+
+    qint64 transmit(ComPort *from, const char *data, qint64 size);
+    void applyErrors(QByteArray &bytes);
+    void runPty();
+
+    friend class ComPort;
+
+private slots:
+    void timer_timeout();
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // VIRTUAL_SERIAL_LINK_H
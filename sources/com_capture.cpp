@@ -0,0 +1,150 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QtEndian>
+#include <cstring>
+
+#include "com_capture.h"
+
+namespace nayk { //=============================================================
+
+// Out-of-class definitions, the constants are bound to const T& (qMax)
+const quint16 ComCapture::formatVersion;
+const int ComCapture::fileHeaderSize;
+const int ComCapture::recordHeaderSize;
+//==============================================================================
+ComCapture::ComCapture(QObject *parent) : QObject(parent)
+{
+}
+//==============================================================================
+ComCapture::~ComCapture()
+{
+    close();
+}
+//==============================================================================
+QString ComCapture::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool ComCapture::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_lastError = tr("Failed to open capture file '%1': %2")
+                .arg(fileName)
+                .arg(m_file.errorString());
+        return false;
+    }
+
+    char header[fileHeaderSize];
+    std::memcpy(header, fileMagic().constData(), 4);
+    qToLittleEndian<quint16>(formatVersion, header + 4);
+    qToLittleEndian<quint16>(0, header + 6);
+
+    m_block.clear();
+    m_block.reserve(m_blockSize + recordHeaderSize);
+    m_block.append(header, fileHeaderSize);
+    m_recordCount = 0;
+    m_byteCount = 0;
+    return true;
+}
+//==============================================================================
+void ComCapture::close()
+{
+    if(!m_file.isOpen()) return;
+
+    flush();
+    m_file.close();
+}
+//==============================================================================
+bool ComCapture::isOpen() const
+{
+    return m_file.isOpen();
+}
+//==============================================================================
+int ComCapture::blockSize() const
+{
+    return m_blockSize;
+}
+//==============================================================================
+void ComCapture::setBlockSize(int blockSize)
+{
+    m_blockSize = qMax(recordHeaderSize, blockSize);
+}
+//==============================================================================
+quint64 ComCapture::recordCount() const
+{
+    return m_recordCount;
+}
+//==============================================================================
+quint64 ComCapture::byteCount() const
+{
+    return m_byteCount;
+}
+//==============================================================================
+void ComCapture::append(ComCapture::Direction direction, quint16 portId, qint64 timestamp,
+                        const char *data, qint64 size)
+{
+    if(!m_file.isOpen() || !data || (size <= 0)) return;
+
+    char header[recordHeaderSize];
+    qToLittleEndian<qint64>(timestamp, header);
+    qToLittleEndian<quint16>(portId, header + 8);
+    header[10] = static_cast<char>(direction);
+    header[11] = 0;
+    qToLittleEndian<quint32>(static_cast<quint32>(size), header + 12);
+
+    m_block.append(header, recordHeaderSize);
+    m_block.append(data, static_cast<int>(size));
+    ++m_recordCount;
+    m_byteCount += static_cast<quint64>(size);
+
+    if(m_block.size() >= m_blockSize) flush();
+}
+//==============================================================================
+QByteArray ComCapture::fileMagic()
+{
+    return QByteArray("NCAP", 4);
+}
+//==============================================================================
+bool ComCapture::flush()
+{
+    if(!m_file.isOpen() || m_block.isEmpty()) return true;
+
+    const qint64 count = m_file.write(m_block);
+    m_block.resize(0);
+
+    if(count >= 0) return true;
+
+    m_lastError = tr("Failed to write capture file '%1': %2")
+            .arg(m_file.fileName())
+            .arg(m_file.errorString());
+    return false;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
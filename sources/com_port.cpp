@@ -22,10 +22,22 @@
 ** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 **
 ****************************************************************************/
-#include <QtSerialPort/QSerialPortInfo>
+#include <QFile>
 #include <QMetaEnum>
+#include <QMetaMethod>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && (_M_IX86_FP >= 2))
+#    include <emmintrin.h>
+#    define NAYK_SSE2
+#endif
 
 #include "com_port.h"
+#include "com_port_enumerator.h"
+#include "com_port_p.h"
 
 namespace nayk { //=============================================================
 
@@ -33,10 +45,12 @@ namespace nayk { //=============================================================
 //------------------------------------------------------------------------------
 void fillComboBoxPortName(QComboBox *comboBox, const QString &defaultValue)
 {
+    ComPortEnumerator *enumerator = ComPortEnumerator::instance();
+    if(!enumerator->isReady()) enumerator->refreshNow();
+
     int index = 0;
-    for(int i=0; i<QSerialPortInfo::availablePorts().size(); ++i) {
+    for(const QString &name: enumerator->portNames()) {
 
-        QString name = QSerialPortInfo::availablePorts().at(i).portName();
         comboBox->addItem( name, name );
         if(defaultValue == name) index = comboBox->count()-1;
     }
@@ -129,17 +143,112 @@ void fillComboBoxFlowControl(QComboBox *comboBox, QSerialPort::FlowControl defau
 }
 //------------------------------------------------------------------------------
 #endif
+//------------------------------------------------------------------------------
+static const char *findLastOf(const char *data, qint64 size, char first, char second)
+{
+    const char *pos = data + size;
+
+#if defined (NAYK_SSE2)
+    const __m128i firstMask = _mm_set1_epi8(first);
+    const __m128i secondMask = _mm_set1_epi8(second);
+
+    while(pos - data >= 16) {
+
+        pos -= 16;
+        const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>(pos) );
+        const int mask = _mm_movemask_epi8( _mm_or_si128(_mm_cmpeq_epi8(chunk, firstMask),
+                                                         _mm_cmpeq_epi8(chunk, secondMask)) );
+        if(mask == 0) continue;
+
+        for(int i=15; i>=0; --i) {
+            if(mask & (1 << i)) return pos + i;
+        }
+    }
+#endif
+
+    while(pos > data) {
+        --pos;
+        if((*pos == first) || (*pos == second)) return pos;
+    }
+
+    return nullptr;
+}
+#if !defined (WITHOUT_LOG)
+//------------------------------------------------------------------------------
+static ComPort::LogVerbosity logTypeVerbosity(Log::LogType logType)
+{
+    switch (logType) {
+    case Log::LogError:
+    case Log::LogWarning: return ComPort::VerbosityErrors;
+    case Log::LogInfo:    return ComPort::VerbosityInfo;
+    case Log::LogIn:
+    case Log::LogOut:     return ComPort::VerbosityTraffic;
+    default:              return ComPort::VerbosityDebug;
+    }
+}
+//------------------------------------------------------------------------------
+#endif
 //==============================================================================
-ComPort::ComPort(QObject *parent) : QObject(parent)
+ComPort::ComPort(QObject *parent)
+    : QObject(parent),
+      m_private { new ComPortPrivate }
 {
-    connect(&serialPort, &QSerialPort::errorOccurred,
-            this, &ComPort::serialPort_errorOccurred);
+    // The error text is taken in the thread that owns serialPort and handed
+    // over with the queued call, serialPort is never touched from here then
+    connect(&serialPort, &QSerialPort::errorOccurred, this, [this](QSerialPort::SerialPortError error) {
+
+        if(error == QSerialPort::NoError) return;
+
+        const QString errorString = serialPort.errorString();
+        if(QThread::currentThread() == thread()) {
+            serialPort_errorOccurred(error, errorString);
+        }
+        else {
+            QMetaObject::invokeMethod(this, [this, error, errorString]() {
+                serialPort_errorOccurred(error, errorString);
+            }, Qt::QueuedConnection);
+        }
+    }, Qt::DirectConnection);
     connect(&serialPort, &QSerialPort::requestToSendChanged,
             this, &ComPort::serialPort_requestToSendChanged);
+    connect(&serialPort, &QSerialPort::requestToSendChanged, this, [this](bool set) {
+        m_requestToSend.store(set, std::memory_order_release);
+    }, Qt::DirectConnection);
     connect(&serialPort, &QSerialPort::dataTerminalReadyChanged,
             this, &ComPort::serialPort_dataTerminalReadyChanged);
     connect(&serialPort, &QSerialPort::readyRead,
-            this, &ComPort::serialPort_readyRead);
+            this, &ComPort::serialPort_readyRead, Qt::DirectConnection);
+
+    m_private->nativePort.setReadyReadHandler([this]() { notifyRingBuffer(); });
+    m_private->nativePort.setErrorHandler([this](const QString &errorString) {
+        QMetaObject::invokeMethod(this, [this, errorString]() {
+            nativePort_error(errorString);
+            linkLost();
+        }, Qt::QueuedConnection);
+    });
+
+    m_txTimer.setSingleShot(true);
+    m_txTimer.setTimerType(Qt::PreciseTimer);
+    m_txClock.start();
+    connect(&m_txTimer, &QTimer::timeout, this, &ComPort::flushTxQueue);
+
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &ComPort::reconnectTimer_timeout);
+    connect(this, &ComPort::readyChange, this, [this](bool ready) {
+        if(ready && !m_txQueue.isEmpty()) flushTxQueue();
+    });
+}
+//==============================================================================
+ComPort::~ComPort()
+{
+    m_private->nativePort.close();
+
+    if(m_ioThread) {
+        runInPortThread([this]() { serialPort.close(); });
+        stopIoThread();
+    }
+
+    delete m_private;
 }
 //==============================================================================
 QString ComPort::lastError() const
@@ -150,30 +259,46 @@ QString ComPort::lastError() const
 void ComPort::setPortName(const QString &portName)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set port name: %2")
-                .arg(serialPort.portName())
-                .arg(portName), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set port name: %2")
+                    .arg(m_settings.portName)
+                    .arg(portName), Log::LogDbg );
+    }
 #endif
 
-    serialPort.setPortName(portName);
+    runInPortThread([&]() { serialPort.setPortName(portName); });
+    m_settings.portName = portName;
 }
 //==============================================================================
 bool ComPort::setBaudRate(QSerialPort::BaudRate baudRate)
+{
+    return setBaudRate( static_cast<qint32>(baudRate) );
+}
+//==============================================================================
+bool ComPort::setBaudRate(qint32 baudRate)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set BaudRate: %2")
-                .arg(serialPort.portName())
-                .arg(baudRateToStr(baudRate)), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set BaudRate: %2")
+                    .arg(m_settings.portName)
+                    .arg(baudRateToStr(baudRate)), Log::LogDbg );
+    }
 #endif
 
-    if (serialPort.setBaudRate(baudRate)) return true;
+    bool ok = false;
+    runInPortThread([&]() { ok = serialPort.setBaudRate(baudRate); });
+    if (ok && m_private->nativePort.isOpen()) ok = m_private->nativePort.setBaudRate(baudRate);
+    if (ok) {
+        m_settings.baudRate = baudRate;
+        return true;
+    }
 
     m_lastError = tr("%1: Failed to set BaudRate: %2")
-            .arg(serialPort.portName())
+            .arg(m_settings.portName)
             .arg(baudRateToStr(baudRate));
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( m_lastError, Log::LogError);
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
 
     return false;
@@ -182,19 +307,27 @@ bool ComPort::setBaudRate(QSerialPort::BaudRate baudRate)
 bool ComPort::setDataBits(QSerialPort::DataBits dataBits)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set DataBits: %2")
-                .arg(serialPort.portName())
-                .arg(dataBitsToStr(dataBits)), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set DataBits: %2")
+                    .arg(m_settings.portName)
+                    .arg(dataBitsToStr(dataBits)), Log::LogDbg );
+    }
 #endif
 
-    if (serialPort.setDataBits(dataBits)) return true;
+    bool ok = false;
+    runInPortThread([&]() { ok = serialPort.setDataBits(dataBits); });
+    if (ok && m_private->nativePort.isOpen()) ok = m_private->nativePort.setDataBits(dataBits);
+    if (ok) {
+        m_settings.dataBits = dataBits;
+        return true;
+    }
 
     m_lastError = tr("%1: Failed to set DataBits: %2")
-            .arg(serialPort.portName())
+            .arg(m_settings.portName)
             .arg(dataBitsToStr(dataBits));
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( m_lastError, Log::LogError);
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
 
     return false;
@@ -203,19 +336,27 @@ bool ComPort::setDataBits(QSerialPort::DataBits dataBits)
 bool ComPort::setStopBits(QSerialPort::StopBits stopBits)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set StopBits: %2")
-                .arg(serialPort.portName())
-                .arg(stopBitsToStr(stopBits)), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set StopBits: %2")
+                    .arg(m_settings.portName)
+                    .arg(stopBitsToStr(stopBits)), Log::LogDbg );
+    }
 #endif
 
-    if (serialPort.setStopBits(stopBits)) return true;
+    bool ok = false;
+    runInPortThread([&]() { ok = serialPort.setStopBits(stopBits); });
+    if (ok && m_private->nativePort.isOpen()) ok = m_private->nativePort.setStopBits(stopBits);
+    if (ok) {
+        m_settings.stopBits = stopBits;
+        return true;
+    }
 
     m_lastError = tr("%1: Failed to set StopBits: %2")
-            .arg(serialPort.portName())
+            .arg(m_settings.portName)
             .arg(stopBitsToStr(stopBits));
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( m_lastError, Log::LogError);
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
 
     return false;
@@ -224,19 +365,27 @@ bool ComPort::setStopBits(QSerialPort::StopBits stopBits)
 bool ComPort::setParity(QSerialPort::Parity parity)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set Parity: %2")
-                .arg(serialPort.portName())
-                .arg(parityToStr(parity)), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set Parity: %2")
+                    .arg(m_settings.portName)
+                    .arg(parityToStr(parity)), Log::LogDbg );
+    }
 #endif
 
-    if (serialPort.setParity(parity)) return true;
+    bool ok = false;
+    runInPortThread([&]() { ok = serialPort.setParity(parity); });
+    if (ok && m_private->nativePort.isOpen()) ok = m_private->nativePort.setParity(parity);
+    if (ok) {
+        m_settings.parity = parity;
+        return true;
+    }
 
     m_lastError = tr("%1: Failed to set Parity: %2")
-            .arg(serialPort.portName())
+            .arg(m_settings.portName)
             .arg(parityToStr(parity));
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( m_lastError, Log::LogError);
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
 
     return false;
@@ -245,51 +394,179 @@ bool ComPort::setParity(QSerialPort::Parity parity)
 bool ComPort::setFlowControl(QSerialPort::FlowControl flowControl)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set FlowControl: %2")
-                .arg(serialPort.portName())
-                .arg(flowControlToStr(flowControl)), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set FlowControl: %2")
+                    .arg(m_settings.portName)
+                    .arg(flowControlToStr(flowControl)), Log::LogDbg );
+    }
 #endif
 
-    if (serialPort.setFlowControl(flowControl)) return true;
+    bool ok = false;
+    runInPortThread([&]() { ok = serialPort.setFlowControl(flowControl); });
+    if (ok && m_private->nativePort.isOpen()) ok = m_private->nativePort.setFlowControl(flowControl);
+    if (ok) {
+        m_settings.flowControl = flowControl;
+        return true;
+    }
 
     m_lastError = tr("%1: Failed to set FlowControl: %2")
-            .arg(serialPort.portName())
+            .arg(m_settings.portName)
             .arg(flowControlToStr(flowControl));
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( m_lastError, Log::LogError);
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+
+    return false;
+}
+//==============================================================================
+ComPort::Settings ComPort::settings() const
+{
+    // Owner-thread copy, serialPort may live in the I/O thread
+    return m_settings;
+}
+//==============================================================================
+bool ComPort::applySettings(const ComPort::Settings &settings)
+{
+    QString errorString;
+    if(!validateSettings(settings, &errorString)) {
+
+        m_lastError = tr("%1: Invalid port settings: %2")
+                .arg(m_settings.portName)
+                .arg(errorString);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    if(!settings.portName.isEmpty() && (settings.portName != m_settings.portName) && isOpen()) {
+
+        m_lastError = tr("%1: Unable to change port name while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Apply settings: %2 %3, %4, %5, %6")
+                    .arg(settings.portName.isEmpty() ? m_settings.portName : settings.portName)
+                    .arg(baudRateToStr(settings.baudRate))
+                    .arg(dataBitsToStr(settings.dataBits))
+                    .arg(parityToStr(settings.parity))
+                    .arg(stopBitsToStr(settings.stopBits))
+                    .arg(flowControlToStr(settings.flowControl)), Log::LogDbg );
+    }
+#endif
+
+    const Settings previous = this->settings();
+
+    auto apply = [this](const Settings &values) {
+        if(!values.portName.isEmpty() && !serialPort.isOpen()) serialPort.setPortName(values.portName);
+        return serialPort.setBaudRate(values.baudRate)
+                && serialPort.setDataBits(values.dataBits)
+                && serialPort.setStopBits(values.stopBits)
+                && serialPort.setParity(values.parity)
+                && serialPort.setFlowControl(values.flowControl);
+    };
+
+    bool ok = false;
+    runInPortThread([&]() {
+        ok = apply(settings);
+        if(!ok) apply(previous);
+    });
+
+    if(ok && m_private->nativePort.isOpen()) {
+
+        ok = m_private->nativePort.setSettings( settings.baudRate, settings.dataBits, settings.stopBits,
+                                       settings.parity, settings.flowControl );
+        if(!ok) runInPortThread([&]() { apply(previous); });
+    }
+
+    if(ok) {
+        m_settings = settings;
+        if(settings.portName.isEmpty()) m_settings.portName = previous.portName;
+        return true;
+    }
+
+    m_lastError = tr("%1: Failed to apply port settings%2")
+            .arg(m_settings.portName)
+            .arg(m_private->nativePort.isOpen() ? ": " + m_private->nativePort.errorString() : QString());
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
 
     return false;
 }
 //==============================================================================
+bool ComPort::validateSettings(const ComPort::Settings &settings, QString *errorString)
+{
+    QString error;
+
+    if(settings.baudRate <= 0) {
+        error = tr("unsupported baud rate %1").arg(settings.baudRate);
+    }
+    else if((settings.dataBits < QSerialPort::Data5) || (settings.dataBits > QSerialPort::Data8)) {
+        error = tr("unsupported data bits");
+    }
+    else if((settings.stopBits != QSerialPort::OneStop)
+            && (settings.stopBits != QSerialPort::OneAndHalfStop)
+            && (settings.stopBits != QSerialPort::TwoStop)) {
+        error = tr("unsupported stop bits");
+    }
+    else if((settings.parity == QSerialPort::UnknownParity)
+            || !QMetaEnum::fromType<QSerialPort::Parity>().valueToKey(settings.parity)) {
+        error = tr("unsupported parity");
+    }
+    else if((settings.flowControl == QSerialPort::UnknownFlowControl)
+            || !QMetaEnum::fromType<QSerialPort::FlowControl>().valueToKey(settings.flowControl)) {
+        error = tr("unsupported flow control");
+    }
+
+    if(errorString) *errorString = error;
+    return error.isEmpty();
+}
+//==============================================================================
+bool ComPort::open(const ComPort::Settings &settings, bool readOnly)
+{
+    return applySettings(settings) && open(readOnly);
+}
+//==============================================================================
 bool ComPort::open(bool readOnly)
 {
-    if (serialPort.isOpen()) return true;
+    if (isOpen()) return true;
 
+    stopReconnect();
     emit beforeOpen();
 
-    if (serialPort.open( readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite)) {
-
-        serialPort.setReadBufferSize(m_bufferSize);
-        m_buffer.clear();
-        serialPort.clear();
-        m_ready = serialPort.flowControl() == QSerialPort::HardwareControl
-                ? serialPort.isRequestToSend()
-                : true;
+    if (openDevice(readOnly)) {
 
 #if !defined (WITHOUT_LOG)
-        emit toLog( tr("%1: Port is open").arg(serialPort.portName()), Log::LogInfo );
+        if(logEnabled(Log::LogInfo)) {
+            emit toLog( tr("%1: Port is open").arg(m_settings.portName), Log::LogInfo );
+        }
 #endif
         emit afterOpen();
 
         return true;
     }
     else {
-        m_lastError = tr("%1: Failed to open port").arg(serialPort.portName());
+        m_lastError = (m_backend == BackendNative)
+                ? tr("%1: Failed to open port: %2")
+                  .arg(m_settings.portName)
+                  .arg(m_private->nativePort.errorString())
+                : (m_backend == BackendVirtual)
+                  ? tr("%1: Failed to open port: no virtual link").arg(m_settings.portName)
+                  : tr("%1: Failed to open port").arg(m_settings.portName);
 
 #if !defined (WITHOUT_LOG)
-        emit toLog( m_lastError, Log::LogError);
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
         return false;
     }
@@ -297,15 +574,20 @@ bool ComPort::open(bool readOnly)
 //==============================================================================
 void ComPort::close()
 {
-    if(!serialPort.isOpen()) return;
+    stopReconnect();
+    if(!isOpen()) return;
 
     emit beforeClose();
 
-    serialPort.close();
-    m_ready = false;
+    flushTxQueue();
+    m_txQueue.clear();
+    m_txEntries.clear();
+    closeDevice();
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Port is closed").arg(serialPort.portName()), Log::LogInfo );
+    if(logEnabled(Log::LogInfo)) {
+        emit toLog( tr("%1: Port is closed").arg(m_settings.portName), Log::LogInfo );
+    }
 #endif
 
     emit afterClose();
@@ -313,17 +595,37 @@ void ComPort::close()
 //==============================================================================
 bool ComPort::isOpen() const
 {
-    return serialPort.isOpen();
+    return serialPort.isOpen() || m_private->nativePort.isOpen() || m_virtualOpen;
 }
 //==============================================================================
 bool ComPort::isReady()
 {
-    if(!serialPort.isOpen()) return false;
+    if(!isOpen()) return false;
+
+    bool hardwareControl = false;
+    bool requestToSend = false;
+
+    if(m_backend == BackendNative) {
+        hardwareControl = m_settings.flowControl == QSerialPort::HardwareControl;
+        requestToSend = m_private->nativePort.isRequestToSend();
+    }
+    else if(m_backend == BackendVirtual) {
+        return m_ready;
+    }
+    else if(m_ioThread) {
+        // No round trip to the I/O thread per call: the RTS state is cached
+        // there at open and on every change
+        hardwareControl = m_settings.flowControl == QSerialPort::HardwareControl;
+        requestToSend = m_requestToSend.load(std::memory_order_acquire);
+    }
+    else {
+        hardwareControl = serialPort.flowControl() == QSerialPort::HardwareControl;
+        requestToSend = serialPort.isRequestToSend();
+    }
 
-    if((serialPort.flowControl() == QSerialPort::HardwareControl)
-            && (serialPort.isRequestToSend() != m_ready)) {
+    if(hardwareControl && (requestToSend != m_ready)) {
 
-        m_ready = serialPort.isRequestToSend();
+        m_ready = requestToSend;
         emit readyChange(m_ready);
     }
 
@@ -332,100 +634,320 @@ bool ComPort::isReady()
 //==============================================================================
 qint64 ComPort::write(const QByteArray &bytes)
 {
-    if (!serialPort.isOpen()) {
-        m_lastError = tr("%1: Port is not open").arg(serialPort.portName());
-
-#if !defined (WITHOUT_LOG)
-        emit toLog( m_lastError, Log::LogError);
-#endif
-        return 0;
-    }
+    if (!checkPortOpen()) return 0;
+    if (!m_txQueueEnabled) return writeData(bytes.constData(), bytes.size());
+    if (bytes.isEmpty()) return 0;
 
-    qint64 count = serialPort.write(bytes);
+    // A peer holding RTS or XOFF stops the queue from draining; refuse data
+    // past the limit instead of buffering it without bound
+    if(static_cast<qint64>(m_txQueue.size()) + bytes.size() > m_txQueueLimit) {
 
-    if (count > 0) {
+        m_lastError = tr("%1: TX queue is full (%2 of %3 bytes queued)")
+                .arg(m_settings.portName)
+                .arg(m_txQueue.size())
+                .arg(m_txQueueLimit);
 
 #if !defined (WITHOUT_LOG)
-        emit toLog( tr("%1: %2")
-                    .arg(serialPort.portName())
-                    .arg(QString( bytes.left( static_cast<int>(count) ).toHex(' '))), Log::LogOut );
-        emit toLog( tr("%1: Write %2 bytes")
-                    .arg(serialPort.portName())
-                    .arg(count), Log::LogDbg );
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
 #endif
+        return -1;
+    }
 
-        emit bytesWrite(count);
+    m_txQueue.append(bytes);
+    m_txEntries.append( { m_txClock.nsecsElapsed(), bytes.size() } );
+
+    if(m_txQueue.size() >= m_txCoalesceThreshold) {
+        flushTxQueue();
+    }
+    else if(!m_txTimer.isActive()) {
+        m_txTimer.start(m_txCoalesceWindow);
     }
 
-    return count;
+    return bytes.size();
 }
 //==============================================================================
-QByteArray ComPort::read(qint64 count)
+qint64 ComPort::writeUrgent(const QByteArray &bytes)
 {
-    m_buffer.clear();
+    if (!checkPortOpen()) return 0;
+    return writeData(bytes.constData(), bytes.size());
+}
+//==============================================================================
+void ComPort::flushTxQueue()
+{
+    m_txTimer.stop();
+    if(m_txQueue.isEmpty() || !isReady()) return;
+
+    // Short or failed writes (full driver buffer, native EAGAIN) leave the
+    // rest queued; the timer retries it rather than the next write() call
+    const qint64 count = writeData(m_txQueue.constData(), m_txQueue.size());
+    if(count <= 0) {
+        if(isOpen()) m_txTimer.start( qMax(1, m_txCoalesceWindow) );
+        return;
+    }
 
-    if (!serialPort.isOpen()) {
-        m_lastError = tr("%1: Port is not open").arg(serialPort.portName());
+    const qint64 now = m_txClock.nsecsElapsed();
+    qint64 written = 0;
+    int entries = 0;
 
-#if !defined (WITHOUT_LOG)
-        emit toLog( m_lastError, Log::LogError);
-#endif
-        return m_buffer;
+    while((entries < m_txEntries.size())
+          && (written + m_txEntries.at(entries).size <= count)) {
+
+        written += m_txEntries.at(entries).size;
+        addTxLatency( (now - m_txEntries.at(entries).enqueueTime) / 1000 );
+        ++entries;
     }
 
-    m_buffer = (count < 0) ? serialPort.readAll() : serialPort.read(count);
-    if(m_buffer.isEmpty()) return m_buffer;
+    m_txEntries.remove(0, entries);
+    if(!m_txEntries.isEmpty()) m_txEntries.first().size -= count - written;
+
+    m_txQueue.remove(0, static_cast<int>(count));
+    if(!m_txQueue.isEmpty()) m_txTimer.start( qMax(1, m_txCoalesceWindow) );
+}
+//==============================================================================
+bool ComPort::txQueueEnabled() const
+{
+    return m_txQueueEnabled;
+}
+//==============================================================================
+void ComPort::setTxQueueEnabled(bool enabled)
+{
+    if(m_txQueueEnabled && !enabled) flushTxQueue();
+    m_txQueueEnabled = enabled;
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: %2")
-                .arg(serialPort.portName())
-                .arg(QString( m_buffer.toHex(' '))), Log::LogIn );
-    emit toLog( tr("%1: Read %2 bytes")
-                .arg(serialPort.portName())
-                .arg(m_buffer.size()), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set TX queue: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_txQueueEnabled ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
 #endif
+}
+//==============================================================================
+int ComPort::txCoalesceWindow() const
+{
+    return m_txCoalesceWindow;
+}
+//==============================================================================
+void ComPort::setTxCoalesceWindow(int msec)
+{
+    m_txCoalesceWindow = qMax(0, msec);
+}
+//==============================================================================
+qint64 ComPort::txCoalesceThreshold() const
+{
+    return m_txCoalesceThreshold;
+}
+//==============================================================================
+void ComPort::setTxCoalesceThreshold(qint64 bytes)
+{
+    m_txCoalesceThreshold = qMax<qint64>(1, bytes);
+}
+//==============================================================================
+qint64 ComPort::txQueueLimit() const
+{
+    return m_txQueueLimit;
+}
+//==============================================================================
+void ComPort::setTxQueueLimit(qint64 bytes)
+{
+    m_txQueueLimit = qMax<qint64>(1, bytes);
+}
+//==============================================================================
+qint64 ComPort::txQueueSize() const
+{
+    return m_txQueue.size();
+}
+//==============================================================================
+int ComPort::txQueueDepth() const
+{
+    return m_txEntries.size();
+}
+//==============================================================================
+qint64 ComPort::txLatencyPercentile(double percentile) const
+{
+    if(m_txLatencies.isEmpty()) return 0;
 
-    emit bytesRead( m_buffer.size() );
+    QVector<qint64> samples = m_txLatencies;
+    const int index = qBound(0, qRound( qBound(0.0, percentile, 100.0) / 100.0 * (samples.size() - 1) ),
+                             samples.size() - 1);
 
-    if(serialPort.flowControl() != QSerialPort::SoftwareControl) return m_buffer;
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples.at(index);
+}
+//==============================================================================
+const ComPortMetrics &ComPort::metrics() const
+{
+    return m_metrics;
+}
+//==============================================================================
+void ComPort::resetMetrics()
+{
+    m_metrics.reset();
+}
+//==============================================================================
+ComCapture *ComPort::capture() const
+{
+    return m_capture;
+}
+//==============================================================================
+void ComPort::setCapture(ComCapture *capture, quint16 portId)
+{
+    m_capture = capture;
+    m_capturePortId = portId;
+}
+//==============================================================================
+void ComPort::replayReceived(const char *data, qint64 size, qint64 timestamp)
+{
+    if(!data || (size <= 0)) return;
 
-    for(int i=0; i<m_buffer.size(); ++i) {
+    m_buffer.resize(static_cast<int>(size));
+    std::memcpy(m_buffer.data(), data, static_cast<size_t>(size));
+    m_lastReadSize = size;
+    m_lastReadTimestamp = timestamp;
 
-        if ( m_buffer.at(i) == m_charXon ) {
-#if !defined (WITHOUT_LOG)
-            emit toLog( tr("%1: XON symbol found")
-                        .arg(serialPort.portName()), Log::LogDbg );
-#endif
-            emit xon(true);
+    processReceived(m_buffer.constData(), size, &m_buffer);
+}
+//==============================================================================
+void ComPort::addTxLatency(qint64 usec)
+{
+    if(m_txLatencies.size() < txLatencySamples) {
+        m_txLatencies.append(usec);
+    }
+    else {
+        m_txLatencies[m_txLatencyIndex] = usec;
+        m_txLatencyIndex = (m_txLatencyIndex + 1) % txLatencySamples;
+    }
+}
+//==============================================================================
+qint64 ComPort::writeData(const char *data, qint64 size)
+{
+    qint64 count = 0;
+
+    if(m_backend == BackendNative) {
+        count = m_private->nativePort.write(data, size);
+        if(count < 0) nativePort_error(m_private->nativePort.errorString());
+    }
+    else if(m_backend == BackendVirtual) {
+        count = m_private->virtualLink ? m_private->virtualLink->transmit(this, data, size) : -1;
+    }
+    else {
+        runInPortThread([&]() { count = serialPort.write(data, size); });
+    }
+
+    if (count > 0) {
+
+        m_metrics.addSent(count);
 
-            if(!m_ready) {
-                m_ready = true;
-                emit readyChange(m_ready);
-            }
+        if(m_capture) {
+            m_capture->append(ComCapture::DirectionTx, m_capturePortId, monotonicTime(), data, count);
         }
-        else if ( m_buffer.at(i) == m_charXoff ) {
 
 #if !defined (WITHOUT_LOG)
-            emit toLog( tr("%1: XOFF symbol found")
-                        .arg(serialPort.portName()), Log::LogDbg );
+        logTraffic(data, count, Log::LogOut);
+        if(logEnabled(Log::LogDbg)) {
+            emit toLog( tr("%1: Write %2 bytes")
+                        .arg(m_settings.portName)
+                        .arg(count), Log::LogDbg );
+        }
 #endif
-            emit xon(false);
 
-            if(m_ready) {
-                m_ready = false;
-                emit readyChange(m_ready);
-            }
-        }
+        emit bytesWrite(count);
     }
 
+    return count;
+}
+//==============================================================================
+QByteArray ComPort::read(qint64 count)
+{
+    read(m_buffer, count);
     return m_buffer;
 }
 //==============================================================================
+qint64 ComPort::read(QByteArray &buffer, qint64 count)
+{
+    if(&buffer != &m_buffer) m_buffer.resize(0);
+
+    if (!checkPortOpen()) {
+        buffer.resize(0);
+        return 0;
+    }
+
+    qint64 size = bytesAvailable();
+    if((count >= 0) && (count < size)) size = count;
+
+    buffer.resize(static_cast<int>(size));
+    size = (size > 0) ? readData(buffer.data(), size) : 0;
+    buffer.resize(static_cast<int>(qMax<qint64>(size, 0)));
+
+    if(size > 0) processReceived(buffer.constData(), size, &buffer);
+    return size;
+}
+//==============================================================================
+qint64 ComPort::read(char *data, qint64 maxSize)
+{
+    m_buffer.resize(0);
+
+    if (!checkPortOpen()) return 0;
+    if (!data || (maxSize <= 0)) return 0;
+
+    qint64 size = readData(data, maxSize);
+
+    if(size > 0) processReceived(data, size);
+    return qMax<qint64>(size, 0);
+}
+//==============================================================================
+qint64 ComPort::bytesAvailable() const
+{
+    if(!isOpen()) return 0;
+    return useRingBuffer() ? m_private->ringBuffer.size() : serialPort.bytesAvailable();
+}
+//==============================================================================
+//==============================================================================
 QByteArray ComPort::readBuffer() const
 {
     return m_buffer;
 }
 //==============================================================================
+qint64 ComPort::lastReadTimestamp() const
+{
+    return m_lastReadTimestamp;
+}
+//==============================================================================
+qint64 ComPort::byteTimestamp(qint64 index) const
+{
+    return m_lastReadTimestamp - (m_lastReadSize - 1 - index) * charTime();
+}
+//==============================================================================
+qint64 ComPort::charTime() const
+{
+    return charTime( m_settings.baudRate, m_settings.dataBits,
+                     m_settings.parity, m_settings.stopBits );
+}
+//==============================================================================
+qint64 ComPort::charTime(qint32 baudRate, QSerialPort::DataBits dataBits,
+                         QSerialPort::Parity parity, QSerialPort::StopBits stopBits)
+{
+    if(baudRate <= 0) return 0;
+
+    // Line time of one character in half bits: start, data, parity and stop bits
+    qint64 halfBits = 2 + 2 * dataBits;
+    if(parity != QSerialPort::NoParity) halfBits += 2;
+
+    switch (stopBits) {
+    case QSerialPort::TwoStop:        halfBits += 4; break;
+    case QSerialPort::OneAndHalfStop: halfBits += 3; break;
+    default:                          halfBits += 2; break;
+    }
+
+    return halfBits * 500000000 / baudRate;
+}
+//==============================================================================
+qint64 ComPort::monotonicTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+//==============================================================================
 #if defined (QT_GUI_LIB)
 void ComPort::fillComboBoxPortProperty(QComboBox *comboBox, ComPort::PortProperty portProperty,
                                        const QVariant &defaultValue)
@@ -458,11 +980,16 @@ void ComPort::fillComboBoxPortProperty(QComboBox *comboBox, ComPort::PortPropert
 //==============================================================================
 QString ComPort::baudRateToStr(QSerialPort::BaudRate baudRate)
 {
-    if(baudRate == QSerialPort::UnknownBaud) {
+    return baudRateToStr( static_cast<qint32>(baudRate) );
+}
+//==============================================================================
+QString ComPort::baudRateToStr(qint32 baudRate)
+{
+    if(baudRate <= 0) {
         return tr("Unknown");
     }
     else {
-        return QString::number( static_cast<int>(baudRate) );
+        return QString::number(baudRate);
     }
 }
 //==============================================================================
@@ -534,10 +1061,22 @@ QSerialPort::BaudRate ComPort::strToBaudRate(const QString &value)
     }
 }
 //==============================================================================
-QSerialPort::DataBits ComPort::strToDataBits(const QString &value)
+qint32 ComPort::strToBaudRateValue(const QString &value)
 {
     bool ok;
-    int db = value.toInt(&ok);
+    int br = value.toInt(&ok);
+    if(ok && (br > 0)) {
+        return br;
+    }
+    else {
+        return QSerialPort::Baud9600;
+    }
+}
+//==============================================================================
+QSerialPort::DataBits ComPort::strToDataBits(const QString &value)
+{
+    bool ok;
+    int db = value.toInt(&ok);
     if(ok && (db > 4) && (db < 9)) {
         return static_cast<QSerialPort::DataBits>(db);
     }
@@ -601,6 +1140,353 @@ void ComPort::setAutoRead(bool autoRead)
     m_autoRead = autoRead;
 }
 //==============================================================================
+bool ComPort::backpressure() const
+{
+    return m_backpressure;
+}
+//==============================================================================
+bool ComPort::setBackpressure(bool backpressure)
+{
+    if(backpressure == m_backpressure) return true;
+
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change backpressure mode while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    m_backpressure = backpressure;
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set backpressure mode: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_backpressure ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
+#endif
+
+    return true;
+}
+//==============================================================================
+ComPort::OverflowPolicy ComPort::overflowPolicy() const
+{
+    return m_overflowPolicy;
+}
+//==============================================================================
+bool ComPort::setOverflowPolicy(ComPort::OverflowPolicy overflowPolicy)
+{
+    if(overflowPolicy == m_overflowPolicy) return true;
+
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change overflow policy while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    m_overflowPolicy = overflowPolicy;
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set overflow policy: %2")
+                    .arg(m_settings.portName)
+                    .arg(QMetaEnum::fromType<OverflowPolicy>().valueToKey(m_overflowPolicy)),
+                    Log::LogDbg );
+    }
+#endif
+
+    return true;
+}
+//==============================================================================
+quint64 ComPort::overflowDropped() const
+{
+    return m_overflowDropped.load(std::memory_order_relaxed) + m_private->nativePort.limitDropped();
+}
+//==============================================================================
+bool ComPort::threadedMode() const
+{
+    return m_threadedMode;
+}
+//==============================================================================
+bool ComPort::setThreadedMode(bool threadedMode)
+{
+    if(threadedMode == m_threadedMode) return true;
+
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change threaded mode while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    m_threadedMode = threadedMode;
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set threaded mode: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_threadedMode ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
+#endif
+
+    return true;
+}
+//==============================================================================
+QThread *ComPort::ioThread() const
+{
+    return m_sharedIoThread;
+}
+//==============================================================================
+bool ComPort::setIoThread(QThread *ioThread)
+{
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change I/O thread while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    m_sharedIoThread = ioThread;
+    return true;
+}
+//==============================================================================
+qint64 ComPort::ringBufferCapacity() const
+{
+    return m_private->ringBuffer.capacity();
+}
+//==============================================================================
+bool ComPort::setRingBufferCapacity(qint64 capacity)
+{
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change ring buffer capacity while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+    m_private->ringBuffer.setCapacity(capacity);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set ring buffer capacity: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_private->ringBuffer.capacity()), Log::LogDbg );
+    }
+#endif
+
+    return true;
+}
+//==============================================================================
+qint64 ComPort::ringBufferFill() const
+{
+    return m_private->ringBuffer.size();
+}
+//==============================================================================
+qint64 ComPort::ringBufferHighWater() const
+{
+    return m_private->ringBuffer.highWater();
+}
+//==============================================================================
+quint64 ComPort::ringBufferOverflow() const
+{
+    return m_private->ringBuffer.overflowCount();
+}
+//==============================================================================
+quint64 ComPort::ringBufferDropped() const
+{
+    return m_private->ringBuffer.droppedBytes();
+}
+//==============================================================================
+void ComPort::resetRingBufferStatistics()
+{
+    m_private->ringBuffer.resetStatistics();
+}
+//==============================================================================
+ComPort::Backend ComPort::backend() const
+{
+    return m_backend;
+}
+//==============================================================================
+bool ComPort::setBackend(ComPort::Backend backend)
+{
+    if(backend == m_backend) return true;
+
+    if(isOpen()) {
+        m_lastError = tr("%1: Unable to change backend while port is open")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+
+#if !defined (Q_OS_LINUX)
+    if(backend == BackendNative) {
+        m_lastError = tr("%1: Native backend is not supported on this platform")
+                .arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+        return false;
+    }
+#endif
+
+    m_backend = backend;
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set backend: %2")
+                    .arg(m_settings.portName)
+                    .arg(QMetaEnum::fromType<Backend>().valueToKey(m_backend)), Log::LogDbg );
+    }
+#endif
+
+    return true;
+}
+//==============================================================================
+int ComPort::readMinimum() const
+{
+    return m_private->nativePort.readMinimum();
+}
+//==============================================================================
+bool ComPort::setReadMinimum(int readMinimum)
+{
+    if(m_private->nativePort.setReadMinimum(readMinimum)) return true;
+
+    m_lastError = tr("%1: Failed to set VMIN: %2")
+            .arg(m_settings.portName)
+            .arg(m_private->nativePort.errorString());
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+
+    return false;
+}
+//==============================================================================
+int ComPort::readTimeout() const
+{
+    return m_private->nativePort.readTimeout();
+}
+//==============================================================================
+bool ComPort::setReadTimeout(int deciseconds)
+{
+    if(m_private->nativePort.setReadTimeout(deciseconds)) return true;
+
+    m_lastError = tr("%1: Failed to set VTIME: %2")
+            .arg(m_settings.portName)
+            .arg(m_private->nativePort.errorString());
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+
+    return false;
+}
+//==============================================================================
+bool ComPort::lowLatency() const
+{
+    return m_private->nativePort.lowLatency();
+}
+//==============================================================================
+void ComPort::setLowLatency(bool lowLatency)
+{
+    m_private->nativePort.setLowLatency(lowLatency);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set low latency: %2")
+                    .arg(m_settings.portName)
+                    .arg(lowLatency ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
+#endif
+}
+//==============================================================================
+bool ComPort::autoReconnect() const
+{
+    return m_autoReconnect;
+}
+//==============================================================================
+void ComPort::setAutoReconnect(bool autoReconnect)
+{
+    m_autoReconnect = autoReconnect;
+    if(!m_autoReconnect) stopReconnect();
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set auto reconnect: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_autoReconnect ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
+#endif
+}
+//==============================================================================
+int ComPort::reconnectInterval() const
+{
+    return m_reconnectInterval;
+}
+//==============================================================================
+void ComPort::setReconnectInterval(int msec, int maxMsec)
+{
+    m_reconnectInterval = qMax(1, msec);
+    m_maxReconnectInterval = qMax(m_reconnectInterval, maxMsec);
+}
+//==============================================================================
+int ComPort::maxReconnectInterval() const
+{
+    return m_maxReconnectInterval;
+}
+//==============================================================================
+bool ComPort::isReconnecting() const
+{
+    return m_reconnecting;
+}
+//==============================================================================
+quint64 ComPort::reconnectCount() const
+{
+    return m_reconnectCount;
+}
+//==============================================================================
+qint64 ComPort::downtime() const
+{
+    return m_reconnecting ? m_downtime + m_downClock.elapsed() : m_downtime;
+}
+//==============================================================================
+void ComPort::resetReconnectStatistics()
+{
+    m_reconnectCount = 0;
+    m_downtime = 0;
+    if(m_reconnecting) m_downClock.start();
+}
+//==============================================================================
+ComPort::LogVerbosity ComPort::logVerbosity() const
+{
+    return m_logVerbosity;
+}
+//==============================================================================
+void ComPort::setLogVerbosity(ComPort::LogVerbosity logVerbosity)
+{
+    m_logVerbosity = logVerbosity;
+}
+//==============================================================================
 qint64 ComPort::bufferSize() const
 {
     return m_bufferSize;
@@ -611,9 +1497,11 @@ void ComPort::setBufferSize(const qint64 &bufferSize)
     m_bufferSize = bufferSize;
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set buffer size: %2")
-                .arg(serialPort.portName())
-                .arg(m_bufferSize), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set buffer size: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_bufferSize), Log::LogDbg );
+    }
 #endif
 }
 //==============================================================================
@@ -627,9 +1515,11 @@ void ComPort::setCharXon(const QChar &charXon)
     m_charXon = charXon;
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set XON symbol value: %2")
-                .arg(serialPort.portName())
-                .arg(m_charXon), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set XON symbol value: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_charXon), Log::LogDbg );
+    }
 #endif
 }
 //==============================================================================
@@ -643,36 +1533,48 @@ void ComPort::setCharXoff(const QChar &charXoff)
     m_charXoff = charXoff;
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: Set XOFF symbol value: %2")
-                .arg(serialPort.portName())
-                .arg(m_charXon), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Set XOFF symbol value: %2")
+                    .arg(m_settings.portName)
+                    .arg(m_charXon), Log::LogDbg );
+    }
 #endif
 }
 //==============================================================================
-void ComPort::serialPort_errorOccurred(QSerialPort::SerialPortError error)
+void ComPort::serialPort_errorOccurred(QSerialPort::SerialPortError error, const QString &errorString)
 {
-    if(error == QSerialPort::NoError) return;
+    // Failed reopen attempts are expected while the device is away; the
+    // supervisor reports disconnected()/reconnected() instead
+    if(m_reconnecting) return;
 
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: %2")
-                .arg(serialPort.portName())
-                .arg(serialPort.errorString()), Log::LogError );
+    if(logEnabled(Log::LogError)) {
+        emit toLog( tr("%1: %2")
+                    .arg(m_settings.portName)
+                    .arg(errorString), Log::LogError );
+    }
+#else
+    Q_UNUSED(errorString)
 #endif
 
+    m_metrics.addError();
     emit portError();
+    if(error == QSerialPort::ResourceError) linkLost();
 }
 //==============================================================================
 void ComPort::serialPort_requestToSendChanged(bool set)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: RTS changed to '%2'")
-                .arg(serialPort.portName())
-                .arg(set ? tr("ON") : tr("OFF")), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: RTS changed to '%2'")
+                    .arg(m_settings.portName)
+                    .arg(set ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
 #endif
 
     emit rts(set);
 
-    if(serialPort.flowControl() == QSerialPort::HardwareControl) {
+    if(m_settings.flowControl == QSerialPort::HardwareControl) {
         m_ready = set;
         emit readyChange( m_ready );
     }
@@ -681,20 +1583,542 @@ void ComPort::serialPort_requestToSendChanged(bool set)
 void ComPort::serialPort_dataTerminalReadyChanged(bool set)
 {
 #if !defined (WITHOUT_LOG)
-    emit toLog( tr("%1: DTR changed to '%2'")
-                .arg(serialPort.portName())
-                .arg(set ? tr("ON") : tr("OFF")), Log::LogDbg );
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: DTR changed to '%2'")
+                    .arg(m_settings.portName)
+                    .arg(set ? tr("ON") : tr("OFF")), Log::LogDbg );
+    }
 #endif
 
     emit dtr(set);
 }
 //==============================================================================
+bool ComPort::checkPortOpen()
+{
+    if (isOpen()) return true;
+
+    m_lastError = tr("%1: Port is not open").arg(m_settings.portName);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogError)) emit toLog( m_lastError, Log::LogError);
+#endif
+
+    return false;
+}
+//==============================================================================
+bool ComPort::useRingBuffer() const
+{
+    return m_threadedMode || (m_backend != BackendQt)
+            || (m_backpressure && (m_overflowPolicy != OverflowBlock));
+}
+//==============================================================================
+bool ComPort::openDevice(bool readOnly)
+{
+    m_openReadOnly = readOnly;
+    m_readyReadArmed = true;
+    m_producerPaused = false;
+    m_backlogLimit = m_backpressure ? qMin(m_bufferSize, m_private->ringBuffer.capacity()) : 0;
+    m_private->nativePort.setReadLimit( producerLimit(), m_overflowPolicy == OverflowBlock );
+
+    m_buffer.clear();
+    m_buffer.reserve( static_cast<int>(useRingBuffer()
+                                       ? qMax(m_bufferSize, m_private->ringBuffer.capacity())
+                                       : m_bufferSize) );
+    m_private->ringBuffer.clear();
+
+    bool ok = false;
+
+    if(m_backend == BackendNative) {
+        ok = openNative(readOnly);
+    }
+    else if(m_backend == BackendVirtual) {
+        ok = m_virtualOpen = !m_private->virtualLink.isNull();
+        m_ready = true;
+    }
+    else {
+        if(m_threadedMode) startIoThread();
+
+        runInPortThread([&]() {
+
+            ok = serialPort.open( readOnly ? QIODevice::ReadOnly : QIODevice::ReadWrite);
+            if(!ok) return;
+
+            serialPort.setReadBufferSize( (m_backpressure && (m_overflowPolicy != OverflowBlock))
+                                          ? 0
+                                          : m_bufferSize );
+            serialPort.clear();
+            m_requestToSend.store(serialPort.isRequestToSend(), std::memory_order_release);
+            m_ready = serialPort.flowControl() == QSerialPort::HardwareControl
+                    ? m_requestToSend.load(std::memory_order_relaxed)
+                    : true;
+        });
+
+        if(!ok) stopIoThread();
+    }
+
+    return ok;
+}
+//==============================================================================
+void ComPort::closeDevice()
+{
+    if(m_backend == BackendNative) {
+        m_private->nativePort.close();
+    }
+    else if(m_backend == BackendVirtual) {
+        m_virtualOpen = false;
+    }
+    else {
+        runInPortThread([this]() { serialPort.close(); });
+        stopIoThread();
+    }
+
+    m_ready = false;
+}
+//==============================================================================
+bool ComPort::devicePresent() const
+{
+    const QString portName = m_settings.portName;
+    if(portName.startsWith('/')) return QFile::exists(portName);
+
+    // The answer comes from the last enumeration; the refresh started here
+    // is seen by the next reconnect attempt
+    ComPortEnumerator *enumerator = ComPortEnumerator::instance();
+    enumerator->refresh();
+    return enumerator->contains(portName);
+}
+//==============================================================================
+void ComPort::linkLost()
+{
+    if(!m_autoReconnect || !isOpen()) return;
+
+    closeDevice();
+    m_reconnecting = true;
+    m_downClock.start();
+    m_currentReconnectInterval = m_reconnectInterval;
+    m_reconnectTimer.start(m_currentReconnectInterval);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogWarning)) {
+        emit toLog( tr("%1: Link lost, waiting for device").arg(m_settings.portName),
+                    Log::LogWarning );
+    }
+#endif
+
+    emit disconnected();
+}
+//==============================================================================
+void ComPort::stopReconnect()
+{
+    if(!m_reconnecting) return;
+
+    m_reconnecting = false;
+    m_reconnectTimer.stop();
+    m_downtime += m_downClock.elapsed();
+}
+//==============================================================================
+void ComPort::reconnectTimer_timeout()
+{
+    if(devicePresent() && openDevice(m_openReadOnly)) {
+
+        const qint64 downtime = m_downClock.elapsed();
+        m_downtime += downtime;
+        m_reconnecting = false;
+        ++m_reconnectCount;
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogInfo)) {
+            emit toLog( tr("%1: Link restored after %2 ms")
+                        .arg(m_settings.portName)
+                        .arg(downtime), Log::LogInfo );
+        }
+#endif
+
+        emit reconnected();
+        return;
+    }
+
+    m_currentReconnectInterval = qMin(m_currentReconnectInterval * 2, m_maxReconnectInterval);
+    m_reconnectTimer.start(m_currentReconnectInterval);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Device not available, next attempt in %2 ms")
+                    .arg(m_settings.portName)
+                    .arg(m_currentReconnectInterval), Log::LogDbg );
+    }
+#endif
+}
+//==============================================================================
+bool ComPort::openNative(bool readOnly)
+{
+    m_private->nativePort.setPortName( m_settings.portName );
+
+    if(!m_private->nativePort.setSettings( m_settings.baudRate, m_settings.dataBits,
+                                  m_settings.stopBits, m_settings.parity,
+                                  m_settings.flowControl )
+            || !m_private->nativePort.open(readOnly)) {
+        return false;
+    }
+
+    m_ready = m_settings.flowControl == QSerialPort::HardwareControl
+            ? m_private->nativePort.isRequestToSend()
+            : true;
+    return true;
+}
+//==============================================================================
+void ComPort::nativePort_error(const QString &errorString)
+{
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogError)) {
+        emit toLog( tr("%1: %2")
+                    .arg(m_settings.portName)
+                    .arg(errorString), Log::LogError );
+    }
+#else
+    Q_UNUSED(errorString)
+#endif
+
+    m_metrics.addError();
+    emit portError();
+}
+//==============================================================================
+void ComPort::receiveVirtual(const char *data, qint64 size, qint64 timestamp)
+{
+    if(!m_virtualOpen) return;
+
+    const qint64 limit = producerLimit();
+    const qint64 count = (limit > 0) ? qBound<qint64>(0, limit - m_private->ringBuffer.size(), size) : size;
+
+    const qint64 written = m_private->ringBuffer.write(data, count, timestamp);
+    if(count < size) {
+        m_overflowDropped.fetch_add(static_cast<quint64>(size - count), std::memory_order_relaxed);
+    }
+
+    reportOverflow(size - written);
+    notifyRingBuffer();
+}
+//==============================================================================
+qint64 ComPort::readData(char *data, qint64 maxSize)
+{
+    qint64 count = 0;
+    qint64 remaining = 0;
+    qint64 timestamp = 0;
+
+    if(useRingBuffer()) {
+        count = m_private->ringBuffer.read(data, maxSize);
+        timestamp = m_private->ringBuffer.writeTimestamp();
+        remaining = m_private->ringBuffer.size();
+    }
+    else {
+        count = serialPort.read(data, maxSize);
+        timestamp = m_rxTimestamp;
+        remaining = serialPort.bytesAvailable();
+    }
+
+    // The stamp belongs to the newest received byte; bytes still waiting
+    // behind the chunk arrived later by one character time each
+    m_metrics.addReadCall();
+
+    if(count > 0) {
+        m_lastReadSize = count;
+        m_lastReadTimestamp = timestamp - remaining * charTime();
+        m_metrics.addLatency( qMax<qint64>(0, monotonicTime() - m_lastReadTimestamp) / 1000 );
+    }
+
+    // readyRead is re-armed only once the consumer has drained the backlog
+    if(m_backpressure) {
+        if(remaining == 0) m_readyReadArmed = true;
+        resumeProducer();
+    }
+
+    return count;
+}
+//==============================================================================
+void ComPort::processReceived(const char *data, qint64 size, const QByteArray *bytes)
+{
+    static const QMetaMethod receivedSignal = QMetaMethod::fromSignal(&ComPort::received);
+
+    m_metrics.addReceived(size);
+
+    if(m_capture) {
+        m_capture->append(ComCapture::DirectionRx, m_capturePortId, m_lastReadTimestamp, data, size);
+    }
+
+#if !defined (WITHOUT_LOG)
+    logTraffic(data, size, Log::LogIn);
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( tr("%1: Read %2 bytes")
+                    .arg(m_settings.portName)
+                    .arg(size), Log::LogDbg );
+    }
+#endif
+
+    // The chunk itself goes out whatever read overload the consumer used;
+    // a read into a caller buffer is shared, a raw pointer read is copied
+    if(isSignalConnected(receivedSignal)) {
+        emit received( bytes ? *bytes : QByteArray(data, static_cast<int>(size)), m_lastReadTimestamp );
+    }
+
+    emit bytesRead( size );
+    emit bytesReadAt( size, m_lastReadTimestamp );
+
+    if(m_settings.flowControl != QSerialPort::SoftwareControl) return;
+
+    const char *found = findLastOf(data, size, m_charXon.toLatin1(), m_charXoff.toLatin1());
+    if(!found) return;
+
+    const bool on = (*found == m_charXon.toLatin1());
+    m_metrics.addFlowEvent(on);
+
+#if !defined (WITHOUT_LOG)
+    if(logEnabled(Log::LogDbg)) {
+        emit toLog( (on ? tr("%1: XON symbol found") : tr("%1: XOFF symbol found"))
+                    .arg(m_settings.portName), Log::LogDbg );
+    }
+#endif
+
+    emit xon(on);
+
+    if(m_ready != on) {
+        m_ready = on;
+        emit readyChange(m_ready);
+    }
+}
+#if !defined (WITHOUT_LOG)
+//==============================================================================
+bool ComPort::logEnabled(Log::LogType logType) const
+{
+    static const QMetaMethod toLogSignal = QMetaMethod::fromSignal(&ComPort::toLog);
+
+    return (m_logVerbosity >= logTypeVerbosity(logType))
+            && isSignalConnected(toLogSignal);
+}
+//==============================================================================
+void ComPort::logTraffic(const char *data, qint64 size, Log::LogType logType)
+{
+    static const QMetaMethod trafficSignal = QMetaMethod::fromSignal(&ComPort::traffic);
+
+    if(m_logVerbosity < VerbosityTraffic) return;
+
+    if(isSignalConnected(trafficSignal)) {
+        emit traffic( QByteArray(data, static_cast<int>(size)), logType );
+    }
+
+    if(logEnabled(logType)) {
+        emit toLog( tr("%1: %2")
+                    .arg(m_settings.portName)
+                    .arg(QString( QByteArray::fromRawData(data, static_cast<int>(size)).toHex(' '))),
+                    logType );
+    }
+}
+#endif
+//==============================================================================
+void ComPort::startIoThread()
+{
+    if(m_ioThread) return;
+
+    if(m_sharedIoThread) {
+        m_ioThread = m_sharedIoThread;
+    }
+    else {
+        m_ioThread = new QThread(this);
+        m_ioThread->setObjectName( QString("ComPort_%1").arg(m_settings.portName) );
+        m_ioThread->start(QThread::TimeCriticalPriority);
+    }
+
+    serialPort.moveToThread(m_ioThread);
+}
+//==============================================================================
+void ComPort::stopIoThread()
+{
+    if(!m_ioThread) return;
+
+    QThread *ownerThread = thread();
+    runInPortThread([&]() { serialPort.moveToThread(ownerThread); });
+
+    if(m_ioThread != m_sharedIoThread) {
+        m_ioThread->quit();
+        m_ioThread->wait();
+        delete m_ioThread;
+    }
+
+    m_ioThread = nullptr;
+}
+//==============================================================================
+void ComPort::runInPortThread(const std::function<void()> &func)
+{
+    if(serialPort.thread() == QThread::currentThread()) {
+        func();
+    }
+    else {
+        QMetaObject::invokeMethod(&serialPort, func, Qt::BlockingQueuedConnection);
+    }
+}
+//==============================================================================
+void ComPort::ioThread_readyRead()
+{
+    fillRingBuffer();
+    notifyRingBuffer();
+}
+//==============================================================================
+void ComPort::fillRingBuffer()
+{
+    const qint64 timestamp = monotonicTime();
+    const qint64 limit = producerLimit();
+    qint64 available = serialPort.bytesAvailable();
+
+    while(available > 0) {
+
+        char *data = nullptr;
+        qint64 space = m_private->ringBuffer.writeSpace(&data);
+        if(limit > 0) space = qMin(space, limit - m_private->ringBuffer.size());
+
+        if(space <= 0) {
+
+            if((limit == 0) || (m_overflowPolicy != OverflowBlock)) break;
+
+            // Leave the rest in QSerialPort until the consumer frees space
+            m_producerPaused = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(m_private->ringBuffer.size() >= limit) return;
+
+            m_producerPaused = false;
+            continue;
+        }
+
+        qint64 count = serialPort.read(data, qMin(space, available));
+        if(count <= 0) break;
+
+        m_private->ringBuffer.commitWrite(count, timestamp);
+        available = serialPort.bytesAvailable();
+    }
+
+    if(available > 0) {
+
+        char scratch[256];
+        qint64 dropped = 0;
+        qint64 count = 0;
+
+        while((count = serialPort.read(scratch, sizeof(scratch))) > 0) {
+            dropped += count;
+        }
+
+        if(limit > 0) {
+            m_overflowDropped.fetch_add(static_cast<quint64>(dropped), std::memory_order_relaxed);
+        }
+        else {
+            m_private->ringBuffer.addOverflow(dropped);
+        }
+
+        reportOverflow(dropped);
+    }
+}
+//==============================================================================
+void ComPort::reportOverflow(qint64 dropped)
+{
+    if(dropped <= 0) return;
+
+    m_metrics.addDropped(dropped);
+
+    // Losses are summed up until the owner thread gets to report them, so a
+    // flooded port produces one warning per event loop pass at most
+    if(m_overflowReport.fetch_add(static_cast<quint64>(dropped), std::memory_order_relaxed) != 0) return;
+
+    QMetaObject::invokeMethod(this, [this]() {
+
+        const quint64 total = m_overflowReport.exchange(0, std::memory_order_relaxed);
+
+#if !defined (WITHOUT_LOG)
+        if(logEnabled(Log::LogWarning)) {
+            emit toLog( tr("%1: Receive buffer overflow, %2 bytes dropped")
+                        .arg(m_settings.portName)
+                        .arg(total), Log::LogWarning );
+        }
+#else
+        Q_UNUSED(total)
+#endif
+
+        emit portError();
+
+    }, Qt::QueuedConnection);
+}
+//==============================================================================
+qint64 ComPort::producerLimit() const
+{
+    return (m_backpressure && (m_overflowPolicy != OverflowDropOldest))
+            ? m_backlogLimit.load(std::memory_order_relaxed)
+            : 0;
+}
+//==============================================================================
+void ComPort::resumeProducer()
+{
+    if(!m_backpressure || (m_overflowPolicy != OverflowBlock)) return;
+
+    if(m_backend == BackendNative) {
+        m_private->nativePort.resume();
+        return;
+    }
+
+    if(!m_threadedMode) return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!m_producerPaused.exchange(false)) return;
+
+    QMetaObject::invokeMethod(&serialPort, [this]() {
+        if(serialPort.isOpen()) ioThread_readyRead();
+    }, Qt::QueuedConnection);
+}
+//==============================================================================
+void ComPort::notifyRingBuffer()
+{
+    if(m_private->ringBuffer.isEmpty() || m_ringNotifyPending.exchange(true)) return;
+
+    if(m_private->ringNotifier) {
+        m_private->ringNotifier();
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this]() {
+
+        m_ringNotifyPending = false;
+        if(isOpen()) serialPort_readyRead();
+
+    }, Qt::QueuedConnection);
+}
+//==============================================================================
 void ComPort::serialPort_readyRead()
 {
+    if(m_threadedMode && (QThread::currentThread() != thread())) {
+        ioThread_readyRead();
+        return;
+    }
+
+    if(!useRingBuffer()) {
+        m_rxTimestamp = monotonicTime();
+    }
+    else if(!m_threadedMode && (m_backend == BackendQt)) {
+        fillRingBuffer();
+    }
+
+    if(m_backpressure && (m_overflowPolicy == OverflowDropOldest)) {
+        const qint64 excess = m_private->ringBuffer.size() - m_backlogLimit;
+        if(excess > 0) {
+            const qint64 dropped = m_private->ringBuffer.skip(excess);
+            m_overflowDropped.fetch_add(static_cast<quint64>(dropped), std::memory_order_relaxed);
+            m_metrics.addDropped(dropped);
+        }
+    }
+
+    m_metrics.updateBacklog( bytesAvailable() );
+
     if(m_autoRead) {
         read();
     }
-    else {
+    else if(!m_backpressure) {
+        emit readyRead();
+    }
+    else if(m_readyReadArmed && (bytesAvailable() > 0)) {
+        m_readyReadArmed = false;
         emit readyRead();
     }
 }
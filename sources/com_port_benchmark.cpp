@@ -0,0 +1,384 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <ctime>
+#include <limits>
+
+#include "com_port_benchmark.h"
+
+namespace nayk { //=============================================================
+
+//------------------------------------------------------------------------------
+static bool legacyFlowScan(ComPort *port, const QByteArray &buffer, bool ready)
+{
+    // The loop read() ran before the bulk scan: every byte is compared as a
+    // QChar and every flow byte found is reported on its own
+    const QChar charXon = port->charXon();
+    const QChar charXoff = port->charXoff();
+
+    for(int i=0; i<buffer.size(); ++i) {
+
+        if ( buffer.at(i) == charXon ) {
+#if !defined (WITHOUT_LOG)
+            emit port->toLog( ComPort::tr("%1: XON symbol found")
+                              .arg(port->settings().portName), Log::LogDbg );
+#endif
+            emit port->xon(true);
+
+            if(!ready) {
+                ready = true;
+                emit port->readyChange(ready);
+            }
+        }
+        else if ( buffer.at(i) == charXoff ) {
+
+#if !defined (WITHOUT_LOG)
+            emit port->toLog( ComPort::tr("%1: XOFF symbol found")
+                              .arg(port->settings().portName), Log::LogDbg );
+#endif
+            emit port->xon(false);
+
+            if(ready) {
+                ready = false;
+                emit port->readyChange(ready);
+            }
+        }
+    }
+
+    return ready;
+}
+
+//==============================================================================
+ComPortBenchmark::ComPortBenchmark(QObject *parent) : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, [this]() { finish(true); });
+}
+//==============================================================================
+void ComPortBenchmark::setPorts(ComPort *sender, ComPort *receiver)
+{
+    stop();
+    m_sender = sender;
+    m_receiver = receiver;
+}
+//==============================================================================
+int ComPortBenchmark::chunkSize() const
+{
+    return m_chunkSize;
+}
+//==============================================================================
+void ComPortBenchmark::setChunkSize(int chunkSize)
+{
+    m_chunkSize = qMax(1, chunkSize);
+}
+//==============================================================================
+qint64 ComPortBenchmark::totalBytes() const
+{
+    return m_totalBytes;
+}
+//==============================================================================
+void ComPortBenchmark::setTotalBytes(qint64 totalBytes)
+{
+    m_totalBytes = qMax<qint64>(1, totalBytes);
+}
+//==============================================================================
+int ComPortBenchmark::window() const
+{
+    return m_window;
+}
+//==============================================================================
+void ComPortBenchmark::setWindow(int chunks)
+{
+    m_window = qMax(1, chunks);
+}
+//==============================================================================
+int ComPortBenchmark::timeout() const
+{
+    return m_timeout;
+}
+//==============================================================================
+void ComPortBenchmark::setTimeout(int msec)
+{
+    m_timeout = qMax(0, msec);
+}
+//==============================================================================
+ComPortBenchmark::ReadMode ComPortBenchmark::readMode() const
+{
+    return m_readMode;
+}
+//==============================================================================
+void ComPortBenchmark::setReadMode(ReadMode readMode)
+{
+    if(!m_running) m_readMode = readMode;
+}
+//==============================================================================
+bool ComPortBenchmark::isRunning() const
+{
+    return m_running;
+}
+//==============================================================================
+ComPortBenchmark::Result ComPortBenchmark::result() const
+{
+    return m_result;
+}
+//==============================================================================
+ComPortBenchmark::FlowScanResult ComPortBenchmark::runFlowScan(qint64 bufferSize, int rounds)
+{
+    FlowScanResult result;
+    result.bufferSize = qBound<qint64>(64, bufferSize, std::numeric_limits<int>::max());
+    result.rounds = qMax(1, rounds);
+
+    ComPort port;
+    const char xonChar = port.charXon().toLatin1();
+    const char xoffChar = port.charXoff().toLatin1();
+
+    // The last flow byte sits near the start, so the backward scan walks
+    // almost the whole chunk just like the forward one
+    QByteArray chunk(static_cast<int>(result.bufferSize), '\x55');
+    chunk[16] = xonChar;
+    chunk[32] = xoffChar;
+
+    bool legacyState = true;
+    bool state = true;
+    QObject::connect(&port, &ComPort::xon, [&state](bool on) { state = on; });
+
+    port.setFlowControl(QSerialPort::NoFlowControl);
+    qint64 start = ComPort::monotonicTime();
+
+    for(int i=0; i<result.rounds; ++i) {
+        port.replayReceived(chunk.constData(), chunk.size(), start);
+        legacyState = legacyFlowScan(&port, chunk, true);
+    }
+
+    qint64 elapsed = ComPort::monotonicTime() - start;
+    result.legacyBytesPerSecond = (elapsed > 0)
+            ? result.bufferSize * result.rounds * 1e9 / elapsed
+            : 0.0;
+
+    state = true;
+    port.setFlowControl(QSerialPort::SoftwareControl);
+    start = ComPort::monotonicTime();
+
+    for(int i=0; i<result.rounds; ++i) {
+        port.replayReceived(chunk.constData(), chunk.size(), start);
+    }
+
+    elapsed = ComPort::monotonicTime() - start;
+    result.bytesPerSecond = (elapsed > 0)
+            ? result.bufferSize * result.rounds * 1e9 / elapsed
+            : 0.0;
+    result.matched = !legacyState && !state;
+    return result;
+}
+#if !defined (WITHOUT_LOG)
+//==============================================================================
+ComPortBenchmark::TrafficLogResult ComPortBenchmark::runTrafficLog(int chunks, int chunkSize)
+{
+    TrafficLogResult result;
+    result.chunks = qMax(1, chunks);
+    result.chunkSize = qMax(1, chunkSize);
+
+    ComPort port;
+    port.setPortName("benchmark");
+    const QByteArray chunk(result.chunkSize, '\x55');
+    qint64 characters = 0;
+
+    const auto run = [&](bool connected, ComPort::LogVerbosity verbosity) {
+
+        QMetaObject::Connection connection;
+        if(connected) {
+            connection = QObject::connect(&port, &ComPort::toLog, [&characters](const QString &text) {
+                characters += text.size();
+            });
+        }
+
+        port.setLogVerbosity(verbosity);
+        const qint64 start = ComPort::monotonicTime();
+
+        for(qint64 i=0; i<result.chunks; ++i) {
+            port.replayReceived(chunk.constData(), chunk.size(), start);
+        }
+
+        const qint64 elapsed = ComPort::monotonicTime() - start;
+        QObject::disconnect(connection);
+        return (elapsed > 0) ? result.chunks * 1e9 / elapsed : 0.0;
+    };
+
+    result.unconnectedChunksPerSecond = run(false, ComPort::VerbosityDebug);
+    result.filteredChunksPerSecond = run(true, ComPort::VerbosityErrors);
+    result.formattedChunksPerSecond = run(true, ComPort::VerbosityDebug);
+    return result;
+}
+#endif
+//==============================================================================
+bool ComPortBenchmark::start()
+{
+    if(m_running || !m_sender || !m_receiver) return false;
+    if(!m_sender->isOpen() || !m_receiver->isOpen()) return false;
+
+    m_result = Result();
+    m_chunk.resize(m_chunkSize);
+    for(int i=0; i<m_chunk.size(); ++i) m_chunk[i] = static_cast<char>(i);
+
+    m_sendTimes.clear();
+    m_sendTimes.reserve( static_cast<int>(m_totalBytes / m_chunkSize + 1) );
+    m_latencyIndex = 0;
+    m_latencyTotal = 0;
+
+    m_connection = connect(m_receiver, &ComPort::bytesRead,
+                           this, &ComPortBenchmark::receiver_bytesRead);
+
+    if(m_readMode != ReadAuto) {
+        m_readChunk = QByteArray();
+        m_receiverAutoRead = m_receiver->autoRead();
+        m_receiver->setAutoRead(false);
+        m_readConnection = connect(m_receiver, &ComPort::readyRead,
+                                   this, &ComPortBenchmark::receiver_readyRead);
+    }
+
+    m_running = true;
+    m_startCpu = cpuTime();
+    m_startTime = ComPort::monotonicTime();
+    if(m_timeout > 0) m_timer.start(m_timeout);
+
+    sendChunks();
+    return true;
+}
+//==============================================================================
+void ComPortBenchmark::stop()
+{
+    if(m_running) finish(false);
+}
+//==============================================================================
+void ComPortBenchmark::sendChunks()
+{
+    const qint64 window = static_cast<qint64>(m_window) * m_chunkSize;
+
+    while(m_running && m_sender && (m_result.bytesSent < m_totalBytes)
+          && (m_result.bytesSent - m_result.bytesReceived < window)) {
+
+        const qint64 size = qMin<qint64>(m_chunkSize, m_totalBytes - m_result.bytesSent);
+
+        m_sendTimes.append( ComPort::monotonicTime() );
+        const qint64 count = m_sender->writeUrgent( (size == m_chunk.size())
+                                                    ? m_chunk
+                                                    : m_chunk.left(static_cast<int>(size)) );
+        if(count <= 0) {
+            finish(false);
+            return;
+        }
+
+        m_result.bytesSent += count;
+    }
+}
+//==============================================================================
+void ComPortBenchmark::finish(bool timedOut)
+{
+    m_timer.stop();
+    disconnect(m_connection);
+    m_running = false;
+
+    if(m_readConnection) {
+        disconnect(m_readConnection);
+        if(m_receiver) m_receiver->setAutoRead(m_receiverAutoRead);
+    }
+
+    m_result.timedOut = timedOut;
+    m_result.elapsed = ComPort::monotonicTime() - m_startTime;
+    m_result.throughput = (m_result.elapsed > 0)
+            ? m_result.bytesReceived * 1e9 / m_result.elapsed
+            : 0.0;
+    m_result.latencyAverage = (m_latencyIndex > 0) ? m_latencyTotal / m_latencyIndex : 0;
+    m_result.cpuPerByte = static_cast<double>(cpuTime() - m_startCpu)
+            / qMax<qint64>(1, m_result.bytesReceived);
+    m_result.allocationsPerMB = m_result.allocations * 1048576.0
+            / qMax<qint64>(1, m_result.bytesReceived);
+    m_readChunk = QByteArray();
+
+    emit finished(m_result);
+}
+//==============================================================================
+qint64 ComPortBenchmark::cpuTime()
+{
+    // Process CPU time, so I/O threads of the ports are accounted as well
+    return static_cast<qint64>(std::clock()) * 1000000000 / CLOCKS_PER_SEC;
+}
+//==============================================================================
+void ComPortBenchmark::receiver_bytesRead(qint64 count)
+{
+    if(!m_running) return;
+
+    const qint64 now = ComPort::monotonicTime();
+    m_result.bytesReceived += count;
+
+    while((m_latencyIndex < m_sendTimes.size())
+          && (qMin<qint64>(m_totalBytes, static_cast<qint64>(m_latencyIndex + 1) * m_chunkSize)
+              <= m_result.bytesReceived)) {
+
+        const qint64 latency = now - m_sendTimes.at(m_latencyIndex);
+
+        if((m_latencyIndex == 0) || (latency < m_result.latencyMin)) m_result.latencyMin = latency;
+        if(latency > m_result.latencyMax) m_result.latencyMax = latency;
+        m_latencyTotal += latency;
+        ++m_latencyIndex;
+    }
+
+    if(m_result.bytesReceived < m_totalBytes) {
+        sendChunks();
+    }
+    else if(m_readMode == ReadAuto) {
+        finish(false);
+    }
+}
+//==============================================================================
+void ComPortBenchmark::receiver_readyRead()
+{
+    // Completion is checked here rather than from bytesRead, which fires
+    // inside read(), so the last allocation is still counted
+    while(m_running && m_receiver && (m_receiver->bytesAvailable() > 0)) {
+
+        if(m_readMode == ReadCopy) {
+
+            // The previous chunk is still held, as a consumer queueing the
+            // chunks would do, so a new address means a new allocation
+            const QByteArray chunk = m_receiver->read();
+            if(chunk.isEmpty()) break;
+            if(chunk.constData() != m_readChunk.constData()) ++m_result.allocations;
+            m_readChunk = chunk;
+        }
+        else {
+
+            const char *data = m_readChunk.constData();
+            const int capacity = m_readChunk.capacity();
+            if(m_receiver->read(m_readChunk) <= 0) break;
+            if((m_readChunk.constData() != data) || (m_readChunk.capacity() != capacity))
+                ++m_result.allocations;
+        }
+    }
+
+    if(m_running && (m_result.bytesReceived >= m_totalBytes)) finish(false);
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
@@ -0,0 +1,149 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QCoreApplication>
+#include <QPointer>
+
+#include "com_port_enumerator.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+ComPortEnumerator::ComPortEnumerator(QObject *parent) : QObject(parent)
+{
+    m_worker = new QObject();
+    m_worker->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread.setObjectName("ComPortEnumerator");
+    m_thread.start(QThread::LowPriority);
+
+    connect(&m_timer, &QTimer::timeout, this, &ComPortEnumerator::refresh);
+    refresh();
+}
+//==============================================================================
+ComPortEnumerator::~ComPortEnumerator()
+{
+    m_thread.quit();
+    m_thread.wait();
+}
+//==============================================================================
+ComPortEnumerator *ComPortEnumerator::instance()
+{
+    static QPointer<ComPortEnumerator> enumerator;
+    if(!enumerator) enumerator = new ComPortEnumerator(QCoreApplication::instance());
+    return enumerator;
+}
+//==============================================================================
+QList<QSerialPortInfo> ComPortEnumerator::ports() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_ports;
+}
+//==============================================================================
+QStringList ComPortEnumerator::portNames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_portNames;
+}
+//==============================================================================
+bool ComPortEnumerator::contains(const QString &portName) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_portNames.contains(portName);
+}
+//==============================================================================
+bool ComPortEnumerator::isReady() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_ready;
+}
+//==============================================================================
+void ComPortEnumerator::refreshNow()
+{
+    // Blocking scan for callers that cannot wait for the worker, e.g. a
+    // combo box filled before the first refresh has finished
+    update( QSerialPortInfo::availablePorts() );
+}
+//==============================================================================
+int ComPortEnumerator::refreshInterval() const
+{
+    return m_timer.isActive() ? m_timer.interval() : 0;
+}
+//==============================================================================
+void ComPortEnumerator::setRefreshInterval(int msec)
+{
+    if(msec > 0) {
+        m_timer.start(msec);
+    }
+    else {
+        m_timer.stop();
+    }
+}
+//==============================================================================
+void ComPortEnumerator::refresh()
+{
+    if(m_refreshPending.exchange(true)) return;
+
+    QMetaObject::invokeMethod(m_worker, [this]() {
+
+        const QList<QSerialPortInfo> ports = QSerialPortInfo::availablePorts();
+        QMetaObject::invokeMethod(this, [this, ports]() {
+            m_refreshPending = false;
+            update(ports);
+        }, Qt::QueuedConnection);
+
+    }, Qt::QueuedConnection);
+}
+//==============================================================================
+void ComPortEnumerator::update(const QList<QSerialPortInfo> &ports)
+{
+
+    QStringList portNames;
+    portNames.reserve(ports.size());
+    for(const QSerialPortInfo &info: ports) portNames.append(info.portName());
+
+    QStringList added;
+    QStringList removed;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for(const QString &name: portNames) {
+            if(!m_portNames.contains(name)) added.append(name);
+        }
+
+        for(const QString &name: m_portNames) {
+            if(!portNames.contains(name)) removed.append(name);
+        }
+
+        m_ports = ports;
+        m_portNames = portNames;
+        m_ready = true;
+    }
+
+    if(!added.isEmpty() || !removed.isEmpty()) emit portsChanged(added, removed);
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
@@ -0,0 +1,234 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QJsonArray>
+#include <chrono>
+
+#include "com_port_metrics.h"
+
+namespace nayk { //=============================================================
+
+const int ComPortMetrics::rateWindow;
+const int ComPortMetrics::latencyBuckets;
+//------------------------------------------------------------------------------
+static qint64 currentSecond()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+//------------------------------------------------------------------------------
+static void storeMax(std::atomic<qint64> &target, qint64 value)
+{
+    qint64 current = target.load(std::memory_order_relaxed);
+    while((value > current)
+          && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+//==============================================================================
+qint64 ComPortMetrics::Snapshot::latencyPercentile(double percentile) const
+{
+    quint64 total = 0;
+    for(quint64 count: latencyHistogram) total += count;
+    if(total == 0) return 0;
+
+    const quint64 rank = static_cast<quint64>( qBound(0.0, percentile, 100.0) / 100.0 * (total - 1) );
+    quint64 passed = 0;
+
+    for(int i=0; i<latencyHistogram.size(); ++i) {
+        passed += latencyHistogram.at(i);
+        if(passed > rank) return (i == 0) ? 0 : (Q_INT64_C(1) << i) - 1;
+    }
+
+    return 0;
+}
+//==============================================================================
+QJsonObject ComPortMetrics::Snapshot::toJson() const
+{
+    QJsonArray histogram;
+    for(quint64 count: latencyHistogram) histogram.append( static_cast<double>(count) );
+
+    QJsonObject json;
+    json["bytesIn"] = static_cast<double>(bytesIn);
+    json["bytesOut"] = static_cast<double>(bytesOut);
+    json["chunksIn"] = static_cast<double>(chunksIn);
+    json["chunksOut"] = static_cast<double>(chunksOut);
+    json["readCalls"] = static_cast<double>(readCalls);
+    json["errors"] = static_cast<double>(errors);
+    json["bytesDropped"] = static_cast<double>(bytesDropped);
+    json["xonEvents"] = static_cast<double>(xonEvents);
+    json["xoffEvents"] = static_cast<double>(xoffEvents);
+    json["maxBacklog"] = static_cast<double>(maxBacklog);
+    json["rateIn"] = rateIn;
+    json["rateOut"] = rateOut;
+    json["latencyP50"] = static_cast<double>(latencyPercentile(50.0));
+    json["latencyP99"] = static_cast<double>(latencyPercentile(99.0));
+    json["latencyHistogram"] = histogram;
+    return json;
+}
+//==============================================================================
+ComPortMetrics::ComPortMetrics()
+{
+    reset();
+}
+//==============================================================================
+void ComPortMetrics::addReceived(qint64 count)
+{
+    m_bytesIn.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+    m_chunksIn.fetch_add(1, std::memory_order_relaxed);
+    rateSlot(currentSecond()).bytesIn.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::addSent(qint64 count)
+{
+    m_bytesOut.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+    m_chunksOut.fetch_add(1, std::memory_order_relaxed);
+    rateSlot(currentSecond()).bytesOut.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::addReadCall()
+{
+    m_readCalls.fetch_add(1, std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::addError()
+{
+    m_errors.fetch_add(1, std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::addDropped(qint64 count)
+{
+    if(count > 0) m_bytesDropped.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::addFlowEvent(bool xon)
+{
+    (xon ? m_xonEvents : m_xoffEvents).fetch_add(1, std::memory_order_relaxed);
+}
+//==============================================================================
+void ComPortMetrics::updateBacklog(qint64 backlog)
+{
+    storeMax(m_maxBacklog, backlog);
+}
+//==============================================================================
+void ComPortMetrics::addLatency(qint64 usec)
+{
+    int bucket = 0;
+    while((bucket < latencyBuckets - 1) && (usec >> bucket) > 0) ++bucket;
+
+    rateSlot(currentSecond()).latency[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+//==============================================================================
+ComPortMetrics::Snapshot ComPortMetrics::snapshot() const
+{
+    Snapshot result;
+    result.bytesIn = m_bytesIn.load(std::memory_order_relaxed);
+    result.bytesOut = m_bytesOut.load(std::memory_order_relaxed);
+    result.chunksIn = m_chunksIn.load(std::memory_order_relaxed);
+    result.chunksOut = m_chunksOut.load(std::memory_order_relaxed);
+    result.readCalls = m_readCalls.load(std::memory_order_relaxed);
+    result.errors = m_errors.load(std::memory_order_relaxed);
+    result.bytesDropped = m_bytesDropped.load(std::memory_order_relaxed);
+    result.xonEvents = m_xonEvents.load(std::memory_order_relaxed);
+    result.xoffEvents = m_xoffEvents.load(std::memory_order_relaxed);
+    result.maxBacklog = m_maxBacklog.load(std::memory_order_relaxed);
+
+    const qint64 now = currentSecond();
+    quint64 bytesIn = 0;
+    quint64 bytesOut = 0;
+
+    result.latencyHistogram.fill(0, latencyBuckets);
+
+    for(const RateSlot &slot: m_rateSlots) {
+        const qint64 second = slot.second.load(std::memory_order_acquire);
+        if((second < now - rateWindow) || (second > now)) continue;
+
+        for(int i=0; i<latencyBuckets; ++i) {
+            result.latencyHistogram[i] += slot.latency[i].load(std::memory_order_relaxed);
+        }
+
+        if(second == now) continue;
+
+        bytesIn += slot.bytesIn.load(std::memory_order_relaxed);
+        bytesOut += slot.bytesOut.load(std::memory_order_relaxed);
+    }
+
+    result.rateIn = static_cast<double>(bytesIn) / rateWindow;
+    result.rateOut = static_cast<double>(bytesOut) / rateWindow;
+
+    return result;
+}
+//==============================================================================
+void ComPortMetrics::reset()
+{
+    m_bytesIn = 0;
+    m_bytesOut = 0;
+    m_chunksIn = 0;
+    m_chunksOut = 0;
+    m_readCalls = 0;
+    m_errors = 0;
+    m_bytesDropped = 0;
+    m_xonEvents = 0;
+    m_xoffEvents = 0;
+    m_maxBacklog = 0;
+
+    for(RateSlot &slot: m_rateSlots) {
+        slot.second = -1;
+        slot.bytesIn = 0;
+        slot.bytesOut = 0;
+        for(std::atomic<quint64> &count: slot.latency) count = 0;
+    }
+}
+//==============================================================================
+ComPortMetrics::RateSlot &ComPortMetrics::rateSlot(qint64 second)
+{
+    RateSlot &slot = m_rateSlots[second % (rateWindow + 1)];
+    qint64 current = slot.second.load(std::memory_order_acquire);
+
+    // The first writer of a new second claims the slot of an expired one with
+    // a negative epoch, clears it and then publishes the new second. Other
+    // writers never wait for the publish: until then they count into the
+    // previous second rather than into counters that are about to be cleared
+    forever {
+
+        if(current == second) return slot;
+
+        if(current < -1) return m_rateSlots[(second + rateWindow) % (rateWindow + 1)];
+
+        // A writer that slept past the window counts into the newer second
+        if(current > second) return slot;
+
+        if(slot.second.compare_exchange_weak(current, -2 - second, std::memory_order_acquire)) {
+
+            slot.bytesIn.store(0, std::memory_order_relaxed);
+            slot.bytesOut.store(0, std::memory_order_relaxed);
+            for(std::atomic<quint64> &count: slot.latency) count.store(0, std::memory_order_relaxed);
+
+            slot.second.store(second, std::memory_order_release);
+            return slot;
+        }
+    }
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
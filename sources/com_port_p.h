@@ -0,0 +1,87 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#ifndef COM_PORT_P_H
+#define COM_PORT_P_H
+
+#include <QPointer>
+#include <functional>
+
+#include "com_port.h"
+#include "native_serial_port.h"
+#include "ring_buffer.h"
+#include "virtual_serial_link.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+// ComPort internals kept out of the public header: the SPSC ring buffer fed
+// by the I/O thread or the native backend, the native backend itself and the
+// VirtualSerialLink a port is attached to. VirtualSerialLink reaches the port
+// through the static helpers here, not as a friend of ComPort.
+// With a ring notifier set (ComPortPool does), notifyRingBuffer() calls it
+// from the I/O thread instead of queueing a call per port; the owner of the
+// notifier then runs processRing() for the ports it manages.
+//==============================================================================
+class ComPortPrivate
+{
+    Q_DISABLE_COPY(ComPortPrivate)
+
+public:
+    ComPortPrivate() = default;
+
+    RingBuffer ringBuffer;
+    NativeSerialPort nativePort {&ringBuffer};
+    QPointer<VirtualSerialLink> virtualLink;
+    std::function<void()> ringNotifier;
+
+    static void setVirtualLink(ComPort *port, VirtualSerialLink *link)
+    {
+        port->m_private->virtualLink = link;
+    }
+
+    static void receiveVirtual(ComPort *port, const char *data, qint64 size, qint64 timestamp)
+    {
+        port->receiveVirtual(data, size, timestamp);
+    }
+
+    // Set before the port is opened, it is read by the I/O thread
+    static void setRingNotifier(ComPort *port, const std::function<void()> &notifier)
+    {
+        port->m_private->ringNotifier = notifier;
+    }
+
+    // What the queued call of notifyRingBuffer() runs; false if the port
+    // had nothing notified since the last call
+    static bool processRing(ComPort *port)
+    {
+        if(!port->m_ringNotifyPending.exchange(false)) return false;
+        if(port->isOpen()) port->serialPort_readyRead();
+        return true;
+    }
+};
+//==============================================================================
+
+} // namespace nayk //==========================================================
+#endif // COM_PORT_P_H
@@ -0,0 +1,222 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "com_port_pool.h"
+#include "com_port_p.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+ComPortPool::ComPortPool(int threadCount, QObject *parent) : QObject(parent)
+{
+    threadCount = qMax(1, threadCount);
+
+    for(int i=0; i<threadCount; ++i) {
+
+        QThread *thread = new QThread(this);
+        thread->setObjectName( QString("ComPortPool_%1").arg(i) );
+        thread->start(QThread::TimeCriticalPriority);
+        m_threads.append(thread);
+    }
+
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(defaultBatchInterval);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &ComPortPool::timer_timeout);
+}
+//==============================================================================
+ComPortPool::~ComPortPool()
+{
+    m_timer.stop();
+    closeAll();
+    qDeleteAll(m_ports);
+    m_ports.clear();
+
+    for(QThread *thread: m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+}
+//==============================================================================
+int ComPortPool::threadCount() const
+{
+    return m_threads.size();
+}
+//==============================================================================
+int ComPortPool::portCount() const
+{
+    return m_ports.size();
+}
+//==============================================================================
+int ComPortPool::addPort(const QString &portName)
+{
+    const int index = m_ports.size();
+
+    ComPort *comPort = new ComPort();
+    comPort->setPortName(portName);
+    comPort->setAutoRead(false);
+    comPort->setThreadedMode(true);
+    comPort->setIoThread( m_threads.at(index % m_threads.size()) );
+    ComPortPrivate::setRingNotifier(comPort, [this]() { notifyDelivery(); });
+
+    connect(comPort, &ComPort::bytesWrite, this, [this, index](qint64 count) {
+        m_counters[index].bytesWritten += count;
+    });
+    connect(comPort, &ComPort::portError, this, [this, index]() {
+        ++m_counters[index].errors;
+    });
+
+    m_ports.append(comPort);
+    m_counters.append(PortCounters());
+    return index;
+}
+//==============================================================================
+ComPort *ComPortPool::port(int index) const
+{
+    return ((index >= 0) && (index < m_ports.size())) ? m_ports.at(index) : nullptr;
+}
+//==============================================================================
+bool ComPortPool::openAll(bool readOnly)
+{
+    bool ok = true;
+
+    for(ComPort *comPort: m_ports) {
+        if(!comPort->open(readOnly)) ok = false;
+    }
+
+    return ok;
+}
+//==============================================================================
+void ComPortPool::closeAll()
+{
+    for(ComPort *comPort: m_ports) {
+        comPort->close();
+    }
+}
+//==============================================================================
+int ComPortPool::batchInterval() const
+{
+    return m_timer.interval();
+}
+//==============================================================================
+void ComPortPool::setBatchInterval(int msec)
+{
+    m_timer.setInterval( qMax(0, msec) );
+}
+//==============================================================================
+void ComPortPool::setBatchCallback(const BatchCallback &callback)
+{
+    m_callback = callback;
+}
+//==============================================================================
+ComPortPool::PortCounters ComPortPool::counters(int index) const
+{
+    if((index < 0) || (index >= m_ports.size())) return PortCounters();
+
+    PortCounters result = m_counters.at(index);
+    const ComPort *comPort = m_ports.at(index);
+
+    result.ringBufferFill = comPort->ringBufferFill();
+    result.ringBufferHighWater = comPort->ringBufferHighWater();
+    result.ringBufferOverflow = comPort->ringBufferOverflow();
+    result.ringBufferDropped = comPort->ringBufferDropped();
+    return result;
+}
+//==============================================================================
+ComPortPool::PortCounters ComPortPool::totalCounters() const
+{
+    PortCounters total;
+
+    for(int i=0; i<m_ports.size(); ++i) {
+
+        const PortCounters item = counters(i);
+        total.bytesRead += item.bytesRead;
+        total.bytesWritten += item.bytesWritten;
+        total.chunks += item.chunks;
+        total.errors += item.errors;
+        total.ringBufferFill += item.ringBufferFill;
+        total.ringBufferHighWater = qMax(total.ringBufferHighWater, item.ringBufferHighWater);
+        total.ringBufferOverflow += item.ringBufferOverflow;
+        total.ringBufferDropped += item.ringBufferDropped;
+    }
+
+    return total;
+}
+//==============================================================================
+void ComPortPool::resetCounters()
+{
+    for(int i=0; i<m_counters.size(); ++i) {
+        m_counters[i] = PortCounters();
+        m_ports.at(i)->resetRingBufferStatistics();
+    }
+}
+//==============================================================================
+void ComPortPool::notifyDelivery()
+{
+    // Runs in the I/O threads: the first port with new data queues one
+    // delivery, ports notifying before it runs are picked up by it
+    if(m_deliveryPending.exchange(true)) return;
+
+    QMetaObject::invokeMethod(this, [this]() {
+
+        if(m_timer.interval() > 0) m_timer.start();
+        else deliver();
+
+    }, Qt::QueuedConnection);
+}
+//==============================================================================
+void ComPortPool::deliver()
+{
+    // Cleared first: a port notifying during the scan below queues the next
+    // delivery instead of being missed
+    m_deliveryPending = false;
+    m_batch.resize(0);
+
+    for(int i=0; i<m_ports.size(); ++i) {
+
+        ComPort *comPort = m_ports.at(i);
+        if(!ComPortPrivate::processRing(comPort)) continue;
+        if(comPort->bytesAvailable() <= 0) continue;
+
+        Chunk chunk;
+        chunk.port = i;
+        if(comPort->read(chunk.data) <= 0) continue;
+
+        m_counters[i].bytesRead += chunk.data.size();
+        ++m_counters[i].chunks;
+        m_batch.append(chunk);
+    }
+
+    if(m_batch.isEmpty() || !m_callback) return;
+
+    m_callback(m_batch);
+}
+//==============================================================================
+void ComPortPool::timer_timeout()
+{
+    deliver();
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
@@ -0,0 +1,227 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "com_port_pool_benchmark.h"
+#include "com_port_benchmark.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+ComPortPoolBenchmark::ComPortPoolBenchmark(QObject *parent) : QObject(parent)
+{
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+    m_sampleTimer.setInterval(sampleInterval);
+    m_durationTimer.setSingleShot(true);
+
+    connect(&m_sendTimer, &QTimer::timeout, this, &ComPortPoolBenchmark::sendTimer_timeout);
+    connect(&m_sampleTimer, &QTimer::timeout, this, &ComPortPoolBenchmark::sampleTimer_timeout);
+    connect(&m_durationTimer, &QTimer::timeout, this, &ComPortPoolBenchmark::stop);
+}
+//==============================================================================
+ComPortPoolBenchmark::~ComPortPoolBenchmark()
+{
+    m_running = false;
+    release();
+}
+//==============================================================================
+int ComPortPoolBenchmark::portCount() const
+{
+    return m_portCount;
+}
+//==============================================================================
+void ComPortPoolBenchmark::setPortCount(int portCount)
+{
+    // Ports come in linked pairs
+    m_portCount = qMax(2, (portCount + 1) & ~1);
+}
+//==============================================================================
+int ComPortPoolBenchmark::threadCount() const
+{
+    return m_threadCount;
+}
+//==============================================================================
+void ComPortPoolBenchmark::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(1, threadCount);
+}
+//==============================================================================
+int ComPortPoolBenchmark::duration() const
+{
+    return m_duration;
+}
+//==============================================================================
+void ComPortPoolBenchmark::setDuration(int msec)
+{
+    m_duration = qMax(1, msec);
+}
+//==============================================================================
+int ComPortPoolBenchmark::chunkSize() const
+{
+    return m_chunkSize;
+}
+//==============================================================================
+void ComPortPoolBenchmark::setChunkSize(int chunkSize)
+{
+    m_chunkSize = qMax(1, chunkSize);
+}
+//==============================================================================
+int ComPortPoolBenchmark::sendInterval() const
+{
+    return m_sendInterval;
+}
+//==============================================================================
+void ComPortPoolBenchmark::setSendInterval(int msec)
+{
+    m_sendInterval = qMax(1, msec);
+}
+//==============================================================================
+QString ComPortPoolBenchmark::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool ComPortPoolBenchmark::isRunning() const
+{
+    return m_running;
+}
+//==============================================================================
+ComPortPoolBenchmark::Result ComPortPoolBenchmark::result() const
+{
+    return m_result;
+}
+//==============================================================================
+bool ComPortPoolBenchmark::start()
+{
+    if(m_running) return false;
+
+    m_lastError = "";
+    m_result = Result();
+    m_pool = new ComPortPool(m_threadCount, this);
+
+    for(int i=0; i<m_portCount/2; ++i) {
+
+        VirtualSerialLink *link = new VirtualSerialLink(this);
+        link->setPacing(false);
+        m_links.append(link);
+
+        if(!link->openPty()) {
+            m_lastError = link->lastError();
+            release();
+            return false;
+        }
+
+        m_pool->addPort(link->firstPortName());
+        m_pool->addPort(link->secondPortName());
+    }
+
+    if(!m_pool->openAll()) {
+        m_lastError = tr("Unable to open all %1 pool ports").arg(m_pool->portCount());
+        release();
+        return false;
+    }
+
+    m_chunk.resize(m_chunkSize);
+    for(int i=0; i<m_chunk.size(); ++i) m_chunk[i] = static_cast<char>(i);
+
+    m_running = true;
+    m_samples = 0;
+    m_startCpu = m_sampleCpu = ComPortBenchmark::cpuTime();
+    m_startTime = m_sampleTime = ComPort::monotonicTime();
+
+    m_sendTimer.start(m_sendInterval);
+    m_sampleTimer.start();
+    m_durationTimer.start(m_duration);
+    return true;
+}
+//==============================================================================
+void ComPortPoolBenchmark::stop()
+{
+    if(!m_running) return;
+
+    m_sendTimer.stop();
+    m_sampleTimer.stop();
+    m_durationTimer.stop();
+    m_running = false;
+
+    const ComPortPool::PortCounters total = m_pool->totalCounters();
+
+    m_result.ports = m_pool->portCount();
+    m_result.threads = m_pool->threadCount();
+    m_result.elapsed = ComPort::monotonicTime() - m_startTime;
+    m_result.bytesWritten = total.bytesWritten;
+    m_result.bytesRead = total.bytesRead;
+    m_result.throughput = (m_result.elapsed > 0)
+            ? m_result.bytesRead * 1e9 / m_result.elapsed
+            : 0.0;
+    m_result.cpuLoadAverage = (m_result.elapsed > 0)
+            ? 100.0 * (ComPortBenchmark::cpuTime() - m_startCpu) / m_result.elapsed
+            : 0.0;
+    m_result.errors = total.errors;
+    m_result.bytesDropped = total.ringBufferDropped;
+
+    release();
+    emit finished(m_result);
+}
+//==============================================================================
+void ComPortPoolBenchmark::release()
+{
+    // The pool closes its ports before the links tear the ptys down
+    delete m_pool;
+    m_pool = nullptr;
+
+    for(VirtualSerialLink *link: m_links) {
+        link->closePty();
+        delete link;
+    }
+
+    m_links.clear();
+}
+//==============================================================================
+void ComPortPoolBenchmark::sendTimer_timeout()
+{
+    if(!m_running) return;
+
+    for(int i=0; i<m_pool->portCount(); ++i) {
+        m_pool->port(i)->writeUrgent(m_chunk);
+    }
+}
+//==============================================================================
+void ComPortPoolBenchmark::sampleTimer_timeout()
+{
+    const qint64 now = ComPort::monotonicTime();
+    const qint64 cpu = ComPortBenchmark::cpuTime();
+    if(now <= m_sampleTime) return;
+
+    const double load = 100.0 * (cpu - m_sampleCpu) / (now - m_sampleTime);
+
+    if((m_samples == 0) || (load < m_result.cpuLoadMin)) m_result.cpuLoadMin = load;
+    if(load > m_result.cpuLoadMax) m_result.cpuLoadMax = load;
+    ++m_samples;
+
+    m_sampleTime = now;
+    m_sampleCpu = cpu;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
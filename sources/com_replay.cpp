@@ -0,0 +1,272 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+
+#include "com_replay.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+ComReplay::ComReplay(QObject *parent) : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &ComReplay::timer_timeout);
+}
+//==============================================================================
+QString ComReplay::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool ComReplay::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly)) {
+        m_lastError = tr("Failed to open capture file '%1': %2")
+                .arg(fileName)
+                .arg(m_file.errorString());
+        return false;
+    }
+
+    const QByteArray header = m_file.read(ComCapture::fileHeaderSize);
+
+    if((header.size() != ComCapture::fileHeaderSize)
+            || !header.startsWith(ComCapture::fileMagic())
+            || (qFromLittleEndian<quint16>(header.constData() + 4) != ComCapture::formatVersion)) {
+
+        m_lastError = tr("'%1' is not a supported capture file").arg(fileName);
+        m_file.close();
+        return false;
+    }
+
+    m_recordCount = 0;
+    return true;
+}
+//==============================================================================
+void ComReplay::close()
+{
+    stop();
+    m_file.close();
+    m_buffer.clear();
+    m_bufferPos = 0;
+    m_hasPending = false;
+}
+//==============================================================================
+bool ComReplay::isOpen() const
+{
+    return m_file.isOpen();
+}
+//==============================================================================
+bool ComReplay::isRunning() const
+{
+    return m_timer.isActive();
+}
+//==============================================================================
+double ComReplay::speed() const
+{
+    return m_speed;
+}
+//==============================================================================
+void ComReplay::setSpeed(double speed)
+{
+    m_speed = qMax(0.0, speed);
+}
+//==============================================================================
+int ComReplay::portFilter() const
+{
+    return m_portFilter;
+}
+//==============================================================================
+void ComReplay::setPortFilter(int portId)
+{
+    m_portFilter = portId;
+}
+//==============================================================================
+ComPort *ComReplay::target() const
+{
+    return m_target;
+}
+//==============================================================================
+void ComReplay::setTarget(ComPort *port)
+{
+    m_target = port;
+}
+//==============================================================================
+quint64 ComReplay::recordCount() const
+{
+    return m_recordCount;
+}
+//==============================================================================
+bool ComReplay::readRecord(ComReplay::Record &record)
+{
+    forever {
+
+        if(!m_file.isOpen()) return false;
+
+        if(!fill(ComCapture::recordHeaderSize)) {
+            // Clean end of file only on a record boundary
+            if(m_bufferPos < m_buffer.size()) {
+                m_lastError = tr("Truncated record in capture file '%1'").arg(m_file.fileName());
+            }
+            return false;
+        }
+
+        const char *header = m_buffer.constData() + m_bufferPos;
+        const quint32 size = qFromLittleEndian<quint32>(header + 12);
+
+        record.timestamp = qFromLittleEndian<qint64>(header);
+        record.portId = qFromLittleEndian<quint16>(header + 8);
+        record.direction = static_cast<ComCapture::Direction>(header[10]);
+
+        if((size > static_cast<quint32>(std::numeric_limits<int>::max() - ComCapture::recordHeaderSize))
+                || !fill(ComCapture::recordHeaderSize + static_cast<int>(size))) {
+            m_lastError = tr("Truncated record in capture file '%1'").arg(m_file.fileName());
+            return false;
+        }
+
+        record.data.resize(static_cast<int>(size));
+        std::memcpy(record.data.data(),
+                    m_buffer.constData() + m_bufferPos + ComCapture::recordHeaderSize, size);
+        m_bufferPos += ComCapture::recordHeaderSize + static_cast<int>(size);
+
+        if((m_portFilter >= 0) && (static_cast<int>(record.portId) != m_portFilter)) continue;
+
+        ++m_recordCount;
+        return true;
+    }
+}
+//==============================================================================
+quint64 ComReplay::replayAll()
+{
+    stop();
+
+    quint64 count = 0;
+
+    if(m_hasPending) {
+        dispatch(m_pending);
+        m_hasPending = false;
+        ++count;
+    }
+
+    Record record;
+    while(readRecord(record)) {
+        dispatch(record);
+        ++count;
+    }
+
+    emit finished();
+    return count;
+}
+//==============================================================================
+void ComReplay::start()
+{
+    if(!m_file.isOpen() || m_timer.isActive()) return;
+
+    if(!m_hasPending) m_hasPending = readRecord(m_pending);
+
+    if(!m_hasPending) {
+        emit finished();
+        return;
+    }
+
+    m_firstTimestamp = m_pending.timestamp;
+    m_clock.start();
+    m_timer.start(0);
+}
+//==============================================================================
+void ComReplay::stop()
+{
+    m_timer.stop();
+}
+//==============================================================================
+bool ComReplay::fill(int size)
+{
+    if(m_buffer.size() - m_bufferPos >= size) return true;
+
+    m_buffer.remove(0, m_bufferPos);
+    m_bufferPos = 0;
+
+    const int oldSize = m_buffer.size();
+    const int count = qMax(size - oldSize, defaultBlockSize);
+
+    m_buffer.resize(oldSize + count);
+    const qint64 readCount = m_file.read(m_buffer.data() + oldSize, count);
+    m_buffer.resize(oldSize + static_cast<int>(qMax<qint64>(readCount, 0)));
+
+    return m_buffer.size() >= size;
+}
+//==============================================================================
+void ComReplay::dispatch(const ComReplay::Record &record)
+{
+    if(record.direction == ComCapture::DirectionRx) {
+
+        if(m_target) {
+            m_target->replayReceived(record.data.constData(), record.data.size(), record.timestamp);
+        }
+
+        emit received(record.data, record.timestamp, record.portId);
+    }
+    else {
+        emit transmitted(record.data, record.timestamp, record.portId);
+    }
+}
+//==============================================================================
+void ComReplay::timer_timeout()
+{
+    int dispatched = 0;
+
+    while(m_hasPending) {
+
+        if(dispatched >= batchSize) {
+            m_timer.start(0);
+            return;
+        }
+
+        if(m_speed > 0.0) {
+
+            const qint64 due = static_cast<qint64>((m_pending.timestamp - m_firstTimestamp) / m_speed);
+            const qint64 wait = due - m_clock.nsecsElapsed();
+
+            if(wait > 0) {
+                m_timer.start( static_cast<int>(wait / 1000000) );
+                return;
+            }
+        }
+
+        dispatch(m_pending);
+        ++dispatched;
+        m_hasPending = readRecord(m_pending);
+    }
+
+    emit finished();
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
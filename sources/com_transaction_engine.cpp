@@ -0,0 +1,334 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include "com_transaction_engine.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+ComTransactionEngine::ComTransactionEngine(ComPort *port, QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &ComTransactionEngine::timer_timeout);
+    m_clock.start();
+    setPort(port);
+}
+//==============================================================================
+ComPort *ComTransactionEngine::port() const
+{
+    return m_port;
+}
+//==============================================================================
+void ComTransactionEngine::setPort(ComPort *port)
+{
+    if(m_port) disconnect(m_port, nullptr, this, nullptr);
+    m_port = port;
+
+    if(m_port) {
+        connect(m_port, &ComPort::received, this, &ComTransactionEngine::port_received);
+        connect(m_port, &ComPort::afterOpen, this, &ComTransactionEngine::startNext);
+    }
+}
+//==============================================================================
+int ComTransactionEngine::submit(const QByteArray &request, const ResponseMatcher &matcher,
+                                 const Callback &callback, int timeout,
+                                 int slaveId, int priority, int retries)
+{
+    Transaction transaction;
+    transaction.id = ++m_lastId;
+    transaction.sequence = ++m_sequence;
+    transaction.request = request;
+    transaction.matcher = matcher;
+    transaction.callback = callback;
+    transaction.timeout = (timeout < 0) ? defaultTimeout : timeout;
+    transaction.slaveId = slaveId;
+    transaction.priority = priority;
+    transaction.retries = qMax(0, retries);
+
+    m_queue.append(transaction);
+
+    // Submitted from a completion callback: complete() schedules the next one
+    if(!m_completing) startNext();
+
+    return transaction.id;
+}
+//==============================================================================
+bool ComTransactionEngine::cancel(int id)
+{
+    if(m_active && (m_current.id == id)) {
+
+        // The slave may still answer, its reply must not reach the next one
+        m_timer.stop();
+        m_busyTime += m_clock.nsecsElapsed() - m_sentTime;
+        m_rxBuffer.clear();
+        m_current = Transaction();
+        m_active = false;
+
+        if(!m_completing) startNext();
+        return true;
+    }
+
+    for(int i=0; i<m_queue.size(); ++i) {
+
+        if(m_queue.at(i).id == id) {
+            m_queue.removeAt(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+//==============================================================================
+void ComTransactionEngine::clear()
+{
+    m_queue.clear();
+}
+//==============================================================================
+int ComTransactionEngine::slavePriority(int slaveId) const
+{
+    return m_slavePriority.value(slaveId, 0);
+}
+//==============================================================================
+void ComTransactionEngine::setSlavePriority(int slaveId, int priority)
+{
+    m_slavePriority[slaveId] = priority;
+}
+//==============================================================================
+int ComTransactionEngine::pendingCount() const
+{
+    return m_queue.size() + (m_active ? 1 : 0);
+}
+//==============================================================================
+bool ComTransactionEngine::isBusy() const
+{
+    return m_active;
+}
+//==============================================================================
+double ComTransactionEngine::busUtilization() const
+{
+    qint64 busy = m_busyTime;
+    if(m_active) busy += m_clock.nsecsElapsed() - m_sentTime;
+
+    const qint64 elapsed = m_clock.nsecsElapsed() - m_statStart;
+    return (elapsed > 0) ? 100.0 * busy / elapsed : 0.0;
+}
+//==============================================================================
+qint64 ComTransactionEngine::rttMin() const
+{
+    return m_rttMin / 1000;
+}
+//==============================================================================
+qint64 ComTransactionEngine::rttMax() const
+{
+    return m_rttMax / 1000;
+}
+//==============================================================================
+qint64 ComTransactionEngine::rttAverage() const
+{
+    return (m_completedCount > 0)
+            ? m_rttTotal / static_cast<qint64>(m_completedCount) / 1000
+            : 0;
+}
+//==============================================================================
+quint64 ComTransactionEngine::completedCount() const
+{
+    return m_completedCount;
+}
+//==============================================================================
+quint64 ComTransactionEngine::failedCount() const
+{
+    return m_failedCount;
+}
+//==============================================================================
+quint64 ComTransactionEngine::timeoutCount() const
+{
+    return m_timeoutCount;
+}
+//==============================================================================
+quint64 ComTransactionEngine::retryCount() const
+{
+    return m_retryCount;
+}
+//==============================================================================
+void ComTransactionEngine::resetStatistics()
+{
+    m_statStart = m_clock.nsecsElapsed();
+    if(m_active) m_sentTime = m_statStart;
+    m_busyTime = 0;
+    m_rttMin = 0;
+    m_rttMax = 0;
+    m_rttTotal = 0;
+    m_completedCount = 0;
+    m_failedCount = 0;
+    m_timeoutCount = 0;
+    m_retryCount = 0;
+}
+//==============================================================================
+ComTransactionEngine::ResponseMatcher ComTransactionEngine::fixedLengthMatcher(int length)
+{
+    return [length](const QByteArray &data) {
+        return (data.size() >= length) ? length : 0;
+    };
+}
+//==============================================================================
+void ComTransactionEngine::startNext()
+{
+    // A send that fails (or is answered by buffered bytes) completes inside
+    // send(); its startNext() returns here and the loop takes the next
+    // request, so a queue of failing sends does not recurse
+    if(m_active || m_starting) return;
+
+    m_starting = true;
+
+    while(!m_active && !m_queue.isEmpty() && m_port && m_port->isOpen()) {
+
+        int best = 0;
+
+        for(int i=1; i<m_queue.size(); ++i) {
+
+            const Transaction &item = m_queue.at(i);
+            const Transaction &top = m_queue.at(best);
+            const int itemPriority = item.priority + slavePriority(item.slaveId);
+            const int topPriority = top.priority + slavePriority(top.slaveId);
+
+            if((itemPriority > topPriority)
+                    || ((itemPriority == topPriority) && (item.sequence < top.sequence))) {
+                best = i;
+            }
+        }
+
+        m_current = m_queue.takeAt(best);
+        m_active = true;
+        send();
+    }
+
+    m_starting = false;
+
+    if(!m_active && m_queue.isEmpty()) emit idle();
+}
+//==============================================================================
+void ComTransactionEngine::send()
+{
+    m_sentTime = m_clock.nsecsElapsed();
+    m_timer.start(m_current.timeout);
+
+    if(m_port->writeUrgent(m_current.request) != m_current.request.size()) {
+        m_timer.stop();
+        ++m_failedCount;
+        complete(false, QByteArray());
+        return;
+    }
+
+    // Bytes left behind the previous response may already hold this one,
+    // but only if the same slave sent them. A timeout, a failure or a cancel
+    // has already dropped them, and a reply of another slave must not
+    // complete this transaction
+    if(m_rxSlaveId != m_current.slaveId) m_rxBuffer.clear();
+    if(!m_rxBuffer.isEmpty()) matchResponse();
+}
+//==============================================================================
+void ComTransactionEngine::matchResponse()
+{
+    const int length = m_current.matcher ? m_current.matcher(m_rxBuffer) : m_rxBuffer.size();
+    if(length == 0) return;
+
+    if(length > 0) {
+        const QByteArray response = m_rxBuffer.left(length);
+        m_rxBuffer.remove(0, length);
+        m_rxSlaveId = m_current.slaveId;
+        complete(true, response);
+        return;
+    }
+
+    const QByteArray response = m_rxBuffer;
+    m_rxBuffer.clear();
+    retryOrFail(response);
+}
+//==============================================================================
+void ComTransactionEngine::retryOrFail(const QByteArray &response)
+{
+    if(m_current.retries > 0) {
+        --m_current.retries;
+        ++m_retryCount;
+        m_busyTime += m_clock.nsecsElapsed() - m_sentTime;
+        send();
+    }
+    else {
+        ++m_failedCount;
+        complete(false, response);
+    }
+}
+//==============================================================================
+void ComTransactionEngine::complete(bool ok, const QByteArray &response)
+{
+    m_timer.stop();
+
+    const qint64 rtt = m_clock.nsecsElapsed() - m_sentTime;
+    m_busyTime += rtt;
+
+    if(ok) {
+        if((m_completedCount == 0) || (rtt < m_rttMin)) m_rttMin = rtt;
+        if(rtt > m_rttMax) m_rttMax = rtt;
+        m_rttTotal += rtt;
+        ++m_completedCount;
+    }
+
+    if(!ok) m_rxBuffer.clear();
+
+    Transaction transaction = m_current;
+    m_current = Transaction();
+    m_active = false;
+
+    m_completing = true;
+    if(transaction.callback) transaction.callback(transaction.id, ok, response);
+    emit finished(transaction.id, ok, response);
+    m_completing = false;
+
+    // Straight on, without a trip through the event loop between requests
+    startNext();
+}
+//==============================================================================
+void ComTransactionEngine::port_received(const QByteArray &bytes)
+{
+    if(!m_active) return;
+
+    m_rxBuffer.append(bytes);
+    matchResponse();
+}
+//==============================================================================
+void ComTransactionEngine::timer_timeout()
+{
+    if(!m_active) return;
+
+    ++m_timeoutCount;
+
+    const QByteArray response = m_rxBuffer;
+    m_rxBuffer.clear();
+    retryOrFail(response);
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
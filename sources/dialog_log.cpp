@@ -183,11 +183,35 @@ void DialogLog::initializeDialog()
     layout->addLayout( bottomLayout );
     this->setLayout(layout);
 
+    logSearch = new LogSearch(this);
+    connect(logSearch, &LogSearch::matched, this, &DialogLog::logSearch_matched);
+
     logList.reserve(m_maximumBlockCount);
     pushButtonOpenLogDir->setVisible( m_openLogDirButtonVisible );
     checkBoxDark_toggled( m_dark );
 }
 //==============================================================================
+bool DialogLog::openLogFile(const QString &fileName)
+{
+    if(!logSearch || !logSearch->open(fileName)) return false;
+
+    searchLogFile();
+    return true;
+}
+//==============================================================================
+void DialogLog::closeLogFile()
+{
+    if(!isLogFileOpen()) return;
+
+    logSearch->close();
+    applyFilter();
+}
+//==============================================================================
+bool DialogLog::isLogFileOpen() const
+{
+    return logSearch && logSearch->isOpen();
+}
+//==============================================================================
 void DialogLog::checkBlockCount()
 {
     if(logList.size() < m_maximumBlockCount) return;
@@ -196,12 +220,18 @@ void DialogLog::checkBlockCount()
         logList.removeFirst();
     }
 
-    applyFilter();
+    if(!isLogFileOpen()) applyFilter();
 }
 //==============================================================================
 void DialogLog::applyFilter()
 {
     if(!textEditLog) return;
+
+    if(isLogFileOpen()) {
+        searchLogFile();
+        return;
+    }
+
     QScrollBar* sb = textEditLog->verticalScrollBar();
     bool bScroll = sb && (sb->value() == sb->maximum());
 
@@ -285,7 +315,7 @@ void DialogLog::write(const QString &text)
 {
     logList.append(text);
 
-    if(textEditLog && (m_filtrStr.isEmpty() || text.contains(m_filtrStr))) {
+    if(textEditLog && !isLogFileOpen() && (m_filtrStr.isEmpty() || text.contains(m_filtrStr))) {
 
         QScrollBar* sb = textEditLog->verticalScrollBar();
         bool bScroll = sb && (sb->value() == sb->maximum());
@@ -311,6 +341,7 @@ void DialogLog::lineEditFilter_editingFinished()
 //==============================================================================
 void DialogLog::pushButtonClear_clicked()
 {
+    if(logSearch) logSearch->close();
     logList.clear();
     if(textEditLog)
         textEditLog->clear();
@@ -336,5 +367,30 @@ void DialogLog::checkBoxDark_toggled(bool checked)
         applyFilter();
 }
 //==============================================================================
+void DialogLog::searchLogFile()
+{
+    if(!textEditLog) return;
+
+    // Only the newest lines the view keeps are collected, searching from
+    // the end of the file
+    textEditLog->clear();
+    logSearch->setSubstring(m_filtrStr);
+    logSearch->setMaxResults(m_maximumBlockCount);
+    logSearch->start();
+}
+//==============================================================================
+void DialogLog::logSearch_matched(const QStringList &lines)
+{
+    if(!textEditLog) return;
+
+    textEditLog->setUpdatesEnabled(false);
+
+    for(const QString &line: lines) {
+        textEditLog->append( highlight(line, m_dark) );
+    }
+
+    textEditLog->setUpdatesEnabled(true);
+}
+//==============================================================================
 
 } // namespace nayk //==============================================================================
@@ -0,0 +1,460 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QtMath>
+#include <QVector>
+
+#include "frame_assembler.h"
+
+namespace nayk { //=============================================================
+
+//------------------------------------------------------------------------------
+static bool selfTestFailed(QString *errorString, const QString &text)
+{
+    if(errorString) *errorString = QString("FrameAssembler: %1").arg(text);
+    return false;
+}
+//==============================================================================
+FrameAssembler::FrameAssembler(QObject *parent) : QObject(parent)
+{
+    m_buffer.reserve(1024);
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &FrameAssembler::timer_timeout);
+}
+//==============================================================================
+FrameAssembler::FrameAssembler(FramingMode framingMode, QObject *parent)
+    : FrameAssembler(parent)
+{
+    m_framingMode = framingMode;
+}
+//==============================================================================
+FrameAssembler::FramingMode FrameAssembler::framingMode() const
+{
+    return m_framingMode;
+}
+//==============================================================================
+void FrameAssembler::setFramingMode(FramingMode framingMode)
+{
+    clear();
+    m_framingMode = framingMode;
+}
+//==============================================================================
+QByteArray FrameAssembler::startDelimiter() const
+{
+    return m_startDelimiter;
+}
+//==============================================================================
+void FrameAssembler::setStartDelimiter(const QByteArray &startDelimiter)
+{
+    clear();
+    m_startDelimiter = startDelimiter;
+}
+//==============================================================================
+QByteArray FrameAssembler::endDelimiter() const
+{
+    return m_endDelimiter;
+}
+//==============================================================================
+void FrameAssembler::setEndDelimiter(const QByteArray &endDelimiter)
+{
+    clear();
+    m_endDelimiter = endDelimiter;
+}
+//==============================================================================
+bool FrameAssembler::includeDelimiters() const
+{
+    return m_includeDelimiters;
+}
+//==============================================================================
+void FrameAssembler::setIncludeDelimiters(bool includeDelimiters)
+{
+    m_includeDelimiters = includeDelimiters;
+}
+//==============================================================================
+void FrameAssembler::setLengthField(int offset, int size, bool bigEndian, int adjustment)
+{
+    clear();
+    m_lengthOffset = qMax(0, offset);
+    m_lengthSize = qBound(1, size, 4);
+    m_lengthBigEndian = bigEndian;
+    m_lengthAdjustment = adjustment;
+}
+//==============================================================================
+int FrameAssembler::lengthFieldOffset() const
+{
+    return m_lengthOffset;
+}
+//==============================================================================
+int FrameAssembler::lengthFieldSize() const
+{
+    return m_lengthSize;
+}
+//==============================================================================
+bool FrameAssembler::lengthFieldBigEndian() const
+{
+    return m_lengthBigEndian;
+}
+//==============================================================================
+int FrameAssembler::lengthAdjustment() const
+{
+    return m_lengthAdjustment;
+}
+//==============================================================================
+int FrameAssembler::interCharTimeout() const
+{
+    return m_interCharTimeout;
+}
+//==============================================================================
+void FrameAssembler::setInterCharTimeout(int msec)
+{
+    m_interCharTimeout = qMax(1, msec);
+}
+//==============================================================================
+int FrameAssembler::maxFrameSize() const
+{
+    return m_maxFrameSize;
+}
+//==============================================================================
+void FrameAssembler::setMaxFrameSize(int maxFrameSize)
+{
+    m_maxFrameSize = qMax(1, maxFrameSize);
+}
+//==============================================================================
+int FrameAssembler::pendingBytes() const
+{
+    return m_buffer.size() - m_head;
+}
+//==============================================================================
+quint64 FrameAssembler::frameCount() const
+{
+    return m_frameCount;
+}
+//==============================================================================
+quint64 FrameAssembler::discardedBytes() const
+{
+    return m_discardedBytes;
+}
+//==============================================================================
+void FrameAssembler::attach(ComPort *port)
+{
+    detach();
+    if(!port) return;
+
+    m_port = port;
+    m_portConnection = connect(port, &ComPort::received, this, [this](const QByteArray &bytes) {
+        append(bytes);
+    });
+}
+//==============================================================================
+void FrameAssembler::detach()
+{
+    if(m_portConnection) disconnect(m_portConnection);
+    m_port = nullptr;
+}
+//==============================================================================
+int FrameAssembler::silenceInterval(qint32 baudRate, int dataBits, bool parity,
+                                    int stopBits, double chars)
+{
+    if(baudRate <= 0) return 1;
+
+    // Modbus RTU fixes the silence intervals above 19200 baud
+    if(baudRate > 19200) baudRate = 19200;
+
+    const int charBits = 1 + dataBits + (parity ? 1 : 0) + stopBits;
+    return qMax(1, qCeil( chars * charBits * 1000.0 / baudRate ));
+}
+//==============================================================================
+void FrameAssembler::append(const QByteArray &bytes)
+{
+    append(bytes.constData(), bytes.size());
+}
+//==============================================================================
+void FrameAssembler::append(const char *data, qint64 size)
+{
+    if(!data || (size <= 0)) return;
+
+    if((m_framingMode == TimeoutFraming) && (pendingBytes() > 0)
+            && m_lastRxTimer.isValid() && (m_lastRxTimer.elapsed() >= m_interCharTimeout)) {
+        flush();
+    }
+
+    m_buffer.append(data, static_cast<int>(size));
+
+    switch (m_framingMode) {
+    case DelimiterFraming:
+        extractDelimited();
+        break;
+    case LengthFieldFraming:
+        extractLengthField();
+        break;
+    case TimeoutFraming:
+        m_lastRxTimer.start();
+        if(pendingBytes() > m_maxFrameSize) {
+            m_timer.stop();
+            discard(pendingBytes());
+        }
+        else {
+            m_timer.start(m_interCharTimeout);
+        }
+        break;
+    }
+
+    compact();
+}
+//==============================================================================
+void FrameAssembler::clear()
+{
+    m_timer.stop();
+    m_buffer.resize(0);
+    m_head = 0;
+    m_scanPos = 0;
+    m_frameStart = -1;
+}
+//==============================================================================
+void FrameAssembler::flush()
+{
+    m_timer.stop();
+
+    if(pendingBytes() > 0) {
+        emitFrame(m_head, pendingBytes());
+    }
+
+    clear();
+}
+//==============================================================================
+void FrameAssembler::extractDelimited()
+{
+    const int startLen = m_startDelimiter.size();
+    const int endLen = m_endDelimiter.size();
+    const QByteArray &terminator = (endLen > 0) ? m_endDelimiter : m_startDelimiter;
+    const int termLen = terminator.size();
+
+    if(termLen == 0) return;
+
+    forever {
+
+        if(m_frameStart < 0) {
+
+            if(startLen == 0) {
+                m_frameStart = m_head;
+                m_scanPos = qMax(m_scanPos, m_head);
+            }
+            else {
+                int pos = m_buffer.indexOf(m_startDelimiter, qMax(m_head, m_scanPos - startLen + 1));
+
+                if(pos < 0) {
+                    int keep = qMin(startLen - 1, pendingBytes());
+                    discard(pendingBytes() - keep);
+                    m_scanPos = m_buffer.size();
+                    return;
+                }
+
+                discard(pos - m_head);
+                m_frameStart = pos;
+                m_scanPos = pos + startLen;
+            }
+        }
+
+        const int contentStart = m_frameStart + startLen;
+        int pos = m_buffer.indexOf(terminator, qMax(contentStart, m_scanPos - termLen + 1));
+
+        if(pos < 0) {
+            m_scanPos = m_buffer.size();
+
+            if(m_buffer.size() - m_frameStart > m_maxFrameSize) {
+                discard(pendingBytes());
+                m_frameStart = -1;
+            }
+            return;
+        }
+
+        const int frameEnd = (endLen > 0) ? pos + endLen : pos;
+
+        if(m_includeDelimiters) {
+            emitFrame(m_frameStart, frameEnd - m_frameStart);
+        }
+        else {
+            emitFrame(contentStart, pos - contentStart);
+        }
+
+        m_head = frameEnd;
+        m_scanPos = m_head;
+        m_frameStart = -1;
+    }
+}
+//==============================================================================
+void FrameAssembler::extractLengthField()
+{
+    const int headerSize = m_lengthOffset + m_lengthSize;
+
+    while(pendingBytes() >= headerSize) {
+
+        const uchar *field = reinterpret_cast<const uchar*>(m_buffer.constData())
+                + m_head + m_lengthOffset;
+        qint64 length = 0;
+
+        for(int i=0; i<m_lengthSize; ++i) {
+            length = (length << 8) | field[ m_lengthBigEndian ? i : m_lengthSize - 1 - i ];
+        }
+
+        const qint64 total = headerSize + length + m_lengthAdjustment;
+
+        if((total < headerSize) || (total > m_maxFrameSize)) {
+            discard(1);
+            continue;
+        }
+
+        if(pendingBytes() < total) break;
+
+        emitFrame(m_head, static_cast<int>(total));
+        m_head += static_cast<int>(total);
+    }
+
+    m_scanPos = m_head;
+}
+//==============================================================================
+void FrameAssembler::emitFrame(int from, int size)
+{
+    if(size <= 0) return;
+
+    if(size > m_maxFrameSize) {
+        m_discardedBytes += static_cast<quint64>(size);
+        emit bytesDiscarded(size);
+        return;
+    }
+
+    ++m_frameCount;
+    emit frameReady( m_buffer.mid(from, size) );
+}
+//==============================================================================
+void FrameAssembler::discard(int count)
+{
+    if(count <= 0) return;
+
+    m_head += count;
+    m_discardedBytes += static_cast<quint64>(count);
+    emit bytesDiscarded(count);
+}
+//==============================================================================
+void FrameAssembler::compact()
+{
+    if(m_head == 0) return;
+
+    if(m_head >= m_buffer.size()) {
+        m_buffer.resize(0);
+        m_scanPos = 0;
+        m_frameStart = -1;
+        m_head = 0;
+        return;
+    }
+
+    // Shift only once consumed bytes outweigh pending ones, so every byte
+    // is moved a bounded number of times no matter how the stream is split
+    if(m_head < m_buffer.size() - m_head) return;
+
+    m_buffer.remove(0, m_head);
+    m_scanPos = qMax(0, m_scanPos - m_head);
+    if(m_frameStart >= 0) m_frameStart -= m_head;
+    m_head = 0;
+}
+//==============================================================================
+void FrameAssembler::timer_timeout()
+{
+    flush();
+}
+//==============================================================================
+bool FrameAssembler::selfTest(QString *errorString)
+{
+    // The streams go through ComPort::replayReceived() and attach(), the way
+    // received data reaches the assembler, split at every chunk size
+    QByteArray delimitedStream;
+    QByteArray lengthStream;
+    QVector<QByteArray> delimitedFrames;
+    QVector<QByteArray> lengthFrames;
+
+    for(int i=0; i<20; ++i) {
+
+        const QByteArray payload(1 + i * 3 % 17, static_cast<char>('a' + i));
+        QByteArray header(3, '\0');
+        header[0] = '\xAA';
+        header[1] = static_cast<char>(payload.size() >> 8);
+        header[2] = static_cast<char>(payload.size() & 0xFF);
+
+        delimitedStream.append("xx\x02").append(payload).append('\x03');
+        delimitedFrames.append(payload);
+        lengthStream.append(header).append(payload);
+        lengthFrames.append(header + payload);
+    }
+
+    ComPort port;
+    FrameAssembler assembler;
+    QVector<QByteArray> frames;
+    QObject::connect(&assembler, &FrameAssembler::frameReady, [&frames](const QByteArray &frame) {
+        frames.append(frame);
+    });
+    assembler.attach(&port);
+
+    const auto check = [&](const QString &name, const QByteArray &stream,
+                           const QVector<QByteArray> &expected, quint64 discarded) {
+
+        for(int chunkSize=1; chunkSize<=stream.size(); ++chunkSize) {
+
+            assembler.clear();
+            frames.clear();
+            const quint64 discardedBefore = assembler.discardedBytes();
+
+            for(int pos=0; pos<stream.size(); pos+=chunkSize) {
+                port.replayReceived(stream.constData() + pos,
+                                    qMin(chunkSize, stream.size() - pos), 0);
+            }
+
+            if(frames != expected) {
+                return selfTestFailed(errorString, QString("%1 framing split by %2 "
+                                                           "gave %3 frames instead of %4")
+                                      .arg(name).arg(chunkSize).arg(frames.size()).arg(expected.size()));
+            }
+            if(assembler.discardedBytes() - discardedBefore != discarded) {
+                return selfTestFailed(errorString, QString("%1 framing split by %2 "
+                                                           "discarded %3 bytes instead of %4")
+                                      .arg(name).arg(chunkSize)
+                                      .arg(assembler.discardedBytes() - discardedBefore).arg(discarded));
+            }
+        }
+
+        return true;
+    };
+
+    assembler.setStartDelimiter("\x02");
+    assembler.setEndDelimiter("\x03");
+    assembler.setIncludeDelimiters(false);
+    if(!check("delimiter", delimitedStream, delimitedFrames, 40)) return false;
+
+    assembler.setFramingMode(FrameAssembler::LengthFieldFraming);
+    assembler.setLengthField(1, 2, true);
+    return check("length field", lengthStream, lengthFrames, 0);
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
@@ -24,6 +24,18 @@
 ****************************************************************************/
 #include <QCoreApplication>
 #include <QDir>
+#include <QFileInfo>
+#include <QMetaMethod>
+#include <QMetaEnum>
+#include <QtEndian>
+#include <cstring>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QRegularExpression>
+#include <QMap>
+#include <algorithm>
+#include <chrono>
 
 #include "AppCore"
 #include "FileSys"
@@ -33,6 +45,11 @@ namespace nayk { //=============================================================
 
 using namespace file_sys;
 
+const quint16 Log::binaryFormatVersion;
+const int Log::binaryHeaderSize;
+const int Log::binaryRecordHeaderSize;
+const int Log::indexEntrySize;
+
 //==============================================================================
 QString generateLogFileName(const QString &logDir, QDateTime &dateTime)
 {
@@ -47,14 +64,312 @@ QString generateLogFileName(const QString &logDir, QDateTime &dateTime)
     return fileName;
 }
 //==============================================================================
+static quint32 gzipCrc32(quint32 crc, const char *data, qint64 size)
+{
+    static const QVector<quint32> table = []() {
+
+        QVector<quint32> t(256);
+
+        for(quint32 i = 0; i < 256; ++i) {
+
+            quint32 c = i;
+            for(int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            t[static_cast<int>(i)] = c;
+        }
+
+        return t;
+    }();
+
+    crc = ~crc;
+
+    for(qint64 i = 0; i < size; ++i) {
+        crc = table.at( static_cast<int>((crc ^ static_cast<quint8>(data[i])) & 0xFF) ) ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+//==============================================================================
+// Compresses the file chunk by chunk with qCompress(), each chunk becomes one
+// member of a multi-member gzip file (RFC 1952), which gzip, zcat and other
+// tools read as a whole. Rotated logs of any size are compressed in constant
+// memory, and no zlib headers or library are needed beyond QtCore
+static bool gzipFile(const QString &fileName)
+{
+    const int chunkSize = 1048576;
+
+    QFile source(fileName);
+    if(!source.open(QIODevice::ReadOnly)) return false;
+
+    // Write aside and rename, an interrupted run never leaves a broken .gz
+    QFile target(fileName + ".gz.tmp");
+    if(!target.open(QIODevice::WriteOnly)) return false;
+
+    const char header[10] = { '\x1f', '\x8b', '\x08', 0, 0, 0, 0, 0, 0, '\x03' };
+    QByteArray input(chunkSize, Qt::Uninitialized);
+    bool ok = true;
+    bool first = true;
+
+    while(ok) {
+
+        const qint64 size = source.read(input.data(), input.size());
+        if(size < 0) {
+            ok = false;
+            break;
+        }
+        if((size == 0) && !first) break;
+        first = false;
+
+        // qCompress() output: 4-byte length, 2-byte zlib header, raw deflate
+        // stream, 4-byte adler32. gzip keeps the deflate stream as is. An
+        // empty input gets the empty final deflate block
+        const QByteArray zlib = (size > 0)
+                ? qCompress(reinterpret_cast<const uchar*>(input.constData()),
+                            static_cast<int>(size), 9)
+                : QByteArray();
+        if((size > 0) && (zlib.size() < 10)) {
+            ok = false;
+            break;
+        }
+
+        char trailer[8];
+        qToLittleEndian<quint32>(gzipCrc32(0, input.constData(), size), trailer);
+        qToLittleEndian<quint32>(static_cast<quint32>(size), trailer + 4);
+
+        const char *deflateData = (size > 0) ? zlib.constData() + 6 : "\x03\x00";
+        const qint64 deflateSize = (size > 0) ? zlib.size() - 10 : 2;
+
+        ok = (target.write(header, sizeof(header)) == sizeof(header))
+                && (target.write(deflateData, deflateSize) == deflateSize)
+                && (target.write(trailer, sizeof(trailer)) == sizeof(trailer));
+
+        if(size < chunkSize) break;
+    }
+
+    source.close();
+
+    if(!ok || !target.flush()) {
+        target.close();
+        target.remove();
+        return false;
+    }
+
+    target.close();
+    QFile::remove(fileName + ".gz");
+    if(!target.rename(fileName + ".gz")) return false;
+
+    return QFile::remove(fileName);
+}
+//==============================================================================
+// Generation a log directory entry belongs to: "<name>.log", "<name>.log.gz",
+// "<name>.nlog" and "<name>.nidx" all map to <name>, anything else to ""
+static QString logGeneration(const QString &fileName)
+{
+    QString name = fileName;
+    if(name.endsWith(".gz")) name.chop(3);
+
+    for(const QString &ext: { QStringLiteral(".log"), QStringLiteral(".nlog"), QStringLiteral(".nidx") }) {
+        if(name.endsWith(ext)) return name.left(name.size() - ext.size());
+    }
+
+    return QString();
+}
+//------------------------------------------------------------------------------
+static bool selfTestFailed(QString *errorString, const QString &text)
+{
+    if(errorString) *errorString = QString("Log: %1").arg(text);
+    return false;
+}
+//------------------------------------------------------------------------------
+static QString selfTestDir(const QString &logDir, const QString &name)
+{
+    return QDir(logDir).absoluteFilePath( QString("%1_%2").arg(name)
+                                          .arg(QDateTime::currentMSecsSinceEpoch()) );
+}
+//==============================================================================
+// Compression and retention of rotated files, runs on the global thread pool
+class LogHousekeeping : public QRunnable
+{
+public:
+    QString logDir;
+    QString rotatedFile;
+    QString currentGeneration;
+    bool compress {false};
+    int maxFiles {0};
+    int maxAge {0};
+    qint64 maxTotalSize {0};
+
+    void run() override
+    {
+        // One task at a time: retention of a later rotation must not remove
+        // a generation an earlier task is still compressing
+        static QMutex mutex;
+        QMutexLocker locker(&mutex);
+
+        // Only the text log is compressed, LogReader opens .nlog/.nidx as is
+        if(compress) gzipFile(rotatedFile);
+        if((maxFiles <= 0) && (maxAge <= 0) && (maxTotalSize <= 0)) return;
+
+        struct Generation {
+            QStringList files;
+            qint64 size {0};
+            QDateTime modified;
+        };
+
+        // Limits count whole generations (text, gzip, binary and index file
+        // together), and only names generateLogFileName() produces: files
+        // named by the caller or by anything else are never touched.
+        // The names start with the creation time, name order is age order
+        static const QRegularExpression generatedName("^\\d{8}_\\d{6}_\\d{3}$");
+        QMap<QString, Generation> generations;
+        qint64 total = 0;
+
+        for(const QFileInfo &info: QDir(logDir).entryInfoList(QDir::Files, QDir::Name)) {
+
+            const QString name = logGeneration(info.fileName());
+            if(name.isEmpty() || !generatedName.match(name).hasMatch()) continue;
+
+            Generation &generation = generations[name];
+            generation.files << info.absoluteFilePath();
+            generation.size += info.size();
+            if(!generation.modified.isValid() || (info.lastModified() > generation.modified))
+                generation.modified = info.lastModified();
+            total += info.size();
+        }
+
+        const QDateTime ageLimit = QDateTime::currentDateTime().addDays(-maxAge);
+        int count = generations.size();
+
+        for(auto it = generations.constBegin(); it != generations.constEnd(); ++it) {
+
+            if(it.key() == currentGeneration) continue;
+
+            const bool expired = ((maxFiles > 0) && (count > maxFiles))
+                    || ((maxTotalSize > 0) && (total > maxTotalSize))
+                    || ((maxAge > 0) && (it.value().modified < ageLimit));
+            if(!expired) continue;
+
+            for(const QString &fileName: it.value().files) QFile::remove(fileName);
+            --count;
+            total -= it.value().size;
+        }
+    }
+};
+//==============================================================================
+// Width of "[HH:mm:ss.zzz]", the type tag of getLogPrefix() follows it
+static const int prefixTimeSize {14};
+//==============================================================================
+const char twoDigits[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+//==============================================================================
+static inline void putTwoDigits(QChar *out, int value)
+{
+    out[0] = QLatin1Char(twoDigits[value * 2]);
+    out[1] = QLatin1Char(twoDigits[value * 2 + 1]);
+}
+//==============================================================================
 QString Log::getLogPrefix(LogType logType, const QDateTime &date)
 {
-    QString prefix = getLogTypeStr(logType);
+    const QString typeStr = getLogTypeStr(logType);
+
+    if(typeStr.isEmpty())
+        return typeStr;
+
+    if(!date.isValid())
+        return typeStr + " ";
+
+    // "[HH:mm:ss." only changes once a second: keep it per thread and
+    // render just the milliseconds
+    static thread_local int cachedSecond {-1};
+    static thread_local QChar cachedTime[10];
+
+    const int msecs = date.time().msecsSinceStartOfDay();
+    const int second = msecs / 1000;
+    const int millisecond = msecs % 1000;
+
+    if(second != cachedSecond) {
+
+        cachedSecond = second;
+        cachedTime[0] = QLatin1Char('[');
+        putTwoDigits(cachedTime + 1, second / 3600);
+        cachedTime[3] = QLatin1Char(':');
+        putTwoDigits(cachedTime + 4, (second / 60) % 60);
+        cachedTime[6] = QLatin1Char(':');
+        putTwoDigits(cachedTime + 7, second % 60);
+        cachedTime[9] = QLatin1Char('.');
+    }
+
+    QString prefix(prefixTimeSize + 1 + typeStr.size(), Qt::Uninitialized);
+    QChar *out = prefix.data();
+
+    std::copy(cachedTime, cachedTime + 10, out);
+    out[10] = QLatin1Char( static_cast<char>('0' + millisecond / 100) );
+    putTwoDigits(out + 11, millisecond % 100);
+    out[prefixTimeSize - 1] = QLatin1Char(']');
+    std::copy(typeStr.constBegin(), typeStr.constEnd(), out + prefixTimeSize);
+    out[prefixTimeSize + typeStr.size()] = QLatin1Char(' ');
+
+    return prefix;
+}
+//==============================================================================
+bool Log::parseLogPrefix(const char *line, int length, LogType &logType, int &msecs)
+{
+    static const QVector<QByteArray> tags = []() {
+
+        QVector<QByteArray> result;
+
+        for(int i = LogInfo; i < LogOther; ++i) {
+            result.append( getLogTypeStr(static_cast<LogType>(i)).toLatin1() );
+        }
+
+        return result;
+    }();
+
+    logType = LogOther;
+    msecs = -1;
+
+    // An invalid date leaves the time out and starts with the tag
+    int tagPos = 0;
+
+    if((length >= prefixTimeSize) && (line[0] == '[') && (line[3] == ':') && (line[6] == ':')
+            && (line[9] == '.') && (line[prefixTimeSize - 1] == ']')) {
+
+        const auto digit = [line](int i) { return line[i] - '0'; };
+
+        msecs = (((digit(1) * 10 + digit(2)) * 60 + digit(4) * 10 + digit(5)) * 60
+                 + digit(7) * 10 + digit(8)) * 1000
+                + digit(10) * 100 + digit(11) * 10 + digit(12);
+        tagPos = prefixTimeSize;
+    }
+
+    for(int i = 0; i < tags.size(); ++i) {
+
+        const QByteArray &tag = tags.at(i);
+
+        if((length - tagPos >= tag.size())
+                && (std::memcmp(line + tagPos, tag.constData(), static_cast<size_t>(tag.size())) == 0)) {
+            logType = static_cast<LogType>(i);
+            break;
+        }
+    }
+
+    return (msecs >= 0) || (logType != LogOther);
+}
+//==============================================================================
+QDateTime Log::currentTime()
+{
+    const qint64 msecs = QDateTime::currentMSecsSinceEpoch();
+
+    // Resolving the local zone is the expensive part of currentDateTime(),
+    // the offset only changes on DST switches so refresh it once a minute
+    static thread_local qint64 offsetExpires {0};
+    static thread_local int offset {0};
 
-    if(prefix.isEmpty())
-        return prefix;
+    if(msecs >= offsetExpires) {
+        offset = QDateTime::fromMSecsSinceEpoch(msecs).offsetFromUtc();
+        offsetExpires = (msecs / 60000 + 1) * 60000;
+    }
 
-    return date.toString("[HH:mm:ss.zzz]") + prefix + " ";
+    return QDateTime::fromMSecsSinceEpoch(msecs, Qt::OffsetFromUTC, offset);
 }
 //==============================================================================
 Log::LogType Log::strToLogType(const QString &typeStr)
@@ -126,6 +441,9 @@ Log::Log(const QString &logDir, const QString &fileName, QDateTime startTime, QO
 //==============================================================================
 Log::~Log()
 {
+    flushRepeats();
+    stopWriter();
+
     if (m_file.isOpen()) {
 
         if(!writeLastLine()) {
@@ -135,6 +453,30 @@ Log::~Log()
         m_file.close();
         emit closeFile(m_file.fileName());
     }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        closeBinaryFile();
+    }
+
+    emitNotices();
+
+    Stage *stage = m_stages.exchange(nullptr);
+
+    while(stage) {
+
+        Record *record = stage->queue.exchange(nullptr);
+
+        while(record) {
+            Record *next = record->next;
+            delete record;
+            record = next;
+        }
+
+        Stage *next = stage->next;
+        delete stage;
+        stage = next;
+    }
 }
 //==============================================================================
 void Log::setDebugSave(bool enable)
@@ -148,134 +490,1183 @@ bool Log::debugSave() const
     return m_dbgSave;
 }
 //==============================================================================
-QString Log::logDir() const
+bool Log::asyncMode() const
 {
-    return m_logDir;
+    return m_async;
 }
 //==============================================================================
-QString Log::logFileName() const
+void Log::setAsyncMode(bool enable)
 {
-    return m_fileName;
+    if(enable == (m_writerThread != nullptr)) return;
+
+    if(!enable) {
+        stopWriter();
+        return;
+    }
+
+    if(!m_file.isOpen()) {
+        m_lastError = tr("Log file is not open");
+        emit error(m_lastError);
+        return;
+    }
+
+    m_writerStop = false;
+    m_writerFailed = false;
+    m_writerThread = QThread::create([this]() { writerLoop(); });
+    m_writerThread->setObjectName( QString("Log_%1").arg(m_fileName) );
+    m_writerThread->start(QThread::LowPriority);
+    m_async = true;
 }
 //==============================================================================
-QString Log::lastError() const
+int Log::flushInterval() const
 {
-    return m_lastError;
+    return m_flushInterval;
 }
 //==============================================================================
-QString Log::getLogTypeStr(Log::LogType logType)
+void Log::setFlushInterval(int msec)
 {
-    switch (logType) {
-    case LogInfo:    return "[inf]";
-    case LogWarning: return "[wrn]";
-    case LogError:   return "[err]";
-    case LogIn:      return "[<<<]";
-    case LogOut:     return "[>>>]";
-    case LogText:    return "[txt]";
-    case LogDbg:     return "[dbg]";
-    default: break;
-    }
-    return "";
+    m_flushInterval = qMax(1, msec);
 }
 //==============================================================================
-void Log::startLog(const QString &fileName)
+qint64 Log::maxFileSize() const
 {
-    if(m_logDir.right(1) != directorySeparator)
-        m_logDir += directorySeparator;
+    QMutexLocker locker(&m_mutex);
+    return m_maxFileSize;
+}
+//==============================================================================
+void Log::setMaxFileSize(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxFileSize = qMax<qint64>(0, bytes);
+}
+//==============================================================================
+int Log::rotationInterval() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_rotationInterval;
+}
+//==============================================================================
+void Log::setRotationInterval(int sec)
+{
+    QMutexLocker locker(&m_mutex);
+    m_rotationInterval = qMax(0, sec);
+    scheduleRotation( currentTime() );
+}
+//==============================================================================
+int Log::maxFiles() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxFiles;
+}
+//==============================================================================
+int Log::maxAge() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxAge;
+}
+//==============================================================================
+qint64 Log::maxTotalSize() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxTotalSize;
+}
+//==============================================================================
+void Log::setRetention(int maxFiles, int maxAgeDays, qint64 maxTotalSize)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxFiles = qMax(0, maxFiles);
+    m_maxAge = qMax(0, maxAgeDays);
+    m_maxTotalSize = qMax<qint64>(0, maxTotalSize);
+}
+//==============================================================================
+bool Log::compressRotated() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_compressRotated;
+}
+//==============================================================================
+void Log::setCompressRotated(bool enable)
+{
+    QMutexLocker locker(&m_mutex);
+    m_compressRotated = enable;
+}
+//==============================================================================
+bool Log::binaryLog() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_binaryFile.isOpen();
+}
+//==============================================================================
+bool Log::setBinaryLog(bool enable)
+{
+    bool ok = true;
 
-    m_startTime = QDateTime::currentDateTime();
+    {
+        QMutexLocker locker(&m_mutex);
 
-    if(fileName.isEmpty()) {
-        m_fileName = generateLogFileName(m_logDir, m_startTime);
-    }
-    else {
-        m_fileName = fileName;
-    }
+        if(enable == m_binaryFile.isOpen()) return true;
 
-    if(!makePath(m_logDir)) {
-        m_lastError = tr("Failed to create folder \"%1\"").arg(m_logDir);
-        emit error(m_lastError);
-        return;
+        if(!enable) {
+            closeBinaryFile();
+        }
+        else if(!m_file.isOpen()) {
+            m_lastError = tr("Log file is not open");
+            postNotice(NoticeError, m_lastError);
+            ok = false;
+        }
+        else {
+            ok = openBinaryFile() && flushStream();
+        }
     }
 
-    m_file.setFileName(m_logDir + m_fileName);
+    emitNotices();
+    return ok;
+}
+//==============================================================================
+bool Log::textLog() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_textLog;
+}
+//==============================================================================
+bool Log::setTextLog(bool enable)
+{
+    bool ok = true;
 
-    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        m_lastError = tr("Failed to create file \"%1\"").arg(m_file.fileName());
-        emit error(m_lastError);
-        return;
-    }
+    {
+        QMutexLocker locker(&m_mutex);
 
-    emit openFile(m_file.fileName());
-    m_stream.setDevice(&m_file);
+        if(enable == m_textLog) return true;
 
-    if(!writeFirstLine()) {
-        emit error(m_lastError);
+        if(!enable && !m_binaryFile.isOpen()) {
+            m_lastError = tr("Text log can only be turned off while the binary log is on");
+            postNotice(NoticeError, m_lastError);
+            ok = false;
+        }
+        else {
+            m_textLog = enable;
+        }
     }
+
+    emitNotices();
+    return ok;
 }
 //==============================================================================
-bool Log::writeFirstLine()
+QString Log::binaryFileName() const
 {
-    if(!m_file.isOpen()) {
-        m_lastError = tr("Log file is not open");
-        return false;
-    }
+    QMutexLocker locker(&m_mutex);
+    return m_binaryFile.fileName();
+}
+//==============================================================================
+QByteArray Log::binaryMagic()
+{
+    return QByteArray("NLOG", 4);
+}
+//==============================================================================
+QByteArray Log::indexMagic()
+{
+    return QByteArray("NIDX", 4);
+}
+//==============================================================================
+int Log::indexRecords() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_indexRecords;
+}
+//==============================================================================
+int Log::indexBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_indexBytes;
+}
+//==============================================================================
+void Log::setIndexInterval(int records, int bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_indexRecords = qMax(1, records);
+    m_indexBytes = qMax(binaryRecordHeaderSize, bytes);
+}
+//==============================================================================
+void Log::setRateLimit(Log::LogType logType, double perSecond, int burst)
+{
+    if((logType < LogInfo) || (logType > LogOther)) return;
 
-    QString logStr = "----- " + tr("Begin") + " -----";
-    saveToLog(logStr.leftJustified(100,'-'), LogInfo);
-    return true;
+    QMutexLocker locker(&m_limitMutex);
+    Limit &limit = m_typeLimits[logType];
+    limit.rate = qMax(0.0, perSecond);
+    limit.burst = (burst > 0) ? burst : qMax(1.0, limit.rate);
+    limit.tokens = limit.burst;
+    limit.last = 0;
+    updateLimiting();
 }
 //==============================================================================
-bool Log::writeLastLine()
+void Log::setSampling(Log::LogType logType, int oneOf)
 {
-    if(!m_file.isOpen()) {
-        m_lastError = tr("Log file is not open");
-        return false;
-    }
+    if((logType < LogInfo) || (logType > LogOther)) return;
 
-    QDateTime now = (m_startTime.offsetFromUtc() != 0)
-            ? QDateTime::currentDateTime()
-            : QDateTime::currentDateTimeUtc();
-    qint64 n = now.toMSecsSinceEpoch() - m_startTime.toMSecsSinceEpoch();
-    QString logStr = "----- " + tr("End") + ". " + tr("Working time:")
-            + " " + QString::number(n) + " " + tr("msec") +". -----";
+    QMutexLocker locker(&m_limitMutex);
+    m_typeLimits[logType].sampling = qMax(1, oneOf);
+    updateLimiting();
+}
+//==============================================================================
+void Log::setSourceRateLimit(quint16 sourceId, double perSecond, int burst)
+{
+    QMutexLocker locker(&m_limitMutex);
+    Limit &limit = m_sourceLimits[sourceId];
+    limit.rate = qMax(0.0, perSecond);
+    limit.burst = (burst > 0) ? burst : qMax(1.0, limit.rate);
+    limit.tokens = limit.burst;
+    limit.last = 0;
+    updateLimiting();
+}
+//==============================================================================
+void Log::setSourceSampling(quint16 sourceId, int oneOf)
+{
+    QMutexLocker locker(&m_limitMutex);
+    m_sourceLimits[sourceId].sampling = qMax(1, oneOf);
+    updateLimiting();
+}
+//==============================================================================
+bool Log::suppressDuplicates() const
+{
+    QMutexLocker locker(&m_limitMutex);
+    return m_suppressDuplicates;
+}
+//==============================================================================
+void Log::setSuppressDuplicates(bool enable)
+{
+    if(!enable) flushRepeats();
 
-    saveToLog(logStr.leftJustified(100,'-'), LogInfo);
-    return true;
+    QMutexLocker locker(&m_limitMutex);
+    m_suppressDuplicates = enable;
+    if(!enable) m_repeats.clear();
+    updateLimiting();
 }
 //==============================================================================
-void Log::saveToLog(const QString &text, LogType logType)
+void Log::clearRateLimits()
 {
-    if((logType == LogDbg) && !m_dbgSave) return;
+    QMutexLocker locker(&m_limitMutex);
 
-    if(!m_file.isOpen()) {
-        m_lastError = tr("Log file is not open");
-        emit error(m_lastError);
-        return;
+    for(Limit &limit: m_typeLimits) {
+        limit.rate = 0.0;
+        limit.sampling = 1;
+    }
+
+    for(Limit &limit: m_sourceLimits) {
+        limit.rate = 0.0;
+        limit.sampling = 1;
+    }
+
+    updateLimiting();
+}
+//==============================================================================
+quint64 Log::suppressedCount(Log::LogType logType) const
+{
+    if((logType < LogInfo) || (logType > LogOther)) return 0;
+
+    QMutexLocker locker(&m_limitMutex);
+    return m_typeLimits[logType].suppressed;
+}
+//==============================================================================
+quint64 Log::sourceSuppressedCount(quint16 sourceId) const
+{
+    QMutexLocker locker(&m_limitMutex);
+    return m_sourceLimits.value(sourceId).suppressed;
+}
+//==============================================================================
+quint64 Log::duplicateCount() const
+{
+    QMutexLocker locker(&m_limitMutex);
+    return m_duplicateCount;
+}
+//==============================================================================
+QJsonObject Log::limitStatistics() const
+{
+    QMutexLocker locker(&m_limitMutex);
+    QJsonObject types;
+    QJsonObject sources;
+
+    for(int i = LogInfo; i <= LogOther; ++i) {
+        const QString name = QMetaEnum::fromType<LogType>().valueToKey(i);
+        types.insert(name, static_cast<double>(m_typeLimits[i].suppressed));
+    }
+
+    for(auto it = m_sourceLimits.constBegin(); it != m_sourceLimits.constEnd(); ++it) {
+        sources.insert(QString::number(it.key()), static_cast<double>(it.value().suppressed));
+    }
+
+    QJsonObject json;
+    json.insert("types", types);
+    json.insert("sources", sources);
+    json.insert("duplicates", static_cast<double>(m_duplicateCount));
+    return json;
+}
+//==============================================================================
+void Log::resetLimitStatistics()
+{
+    QMutexLocker locker(&m_limitMutex);
+
+    for(Limit &limit: m_typeLimits) limit.suppressed = 0;
+    for(Limit &limit: m_sourceLimits) limit.suppressed = 0;
+    m_duplicateCount = 0;
+}
+//==============================================================================
+QString Log::logDir() const
+{
+    return m_logDir;
+}
+//==============================================================================
+QString Log::logFileName() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_fileName;
+}
+//==============================================================================
+QString Log::lastError() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastError;
+}
+//==============================================================================
+QString Log::getLogTypeStr(Log::LogType logType)
+{
+    switch (logType) {
+    case LogInfo:    return QStringLiteral("[inf]");
+    case LogWarning: return QStringLiteral("[wrn]");
+    case LogError:   return QStringLiteral("[err]");
+    case LogIn:      return QStringLiteral("[<<<]");
+    case LogOut:     return QStringLiteral("[>>>]");
+    case LogText:    return QStringLiteral("[txt]");
+    case LogDbg:     return QStringLiteral("[dbg]");
+    default: break;
+    }
+    return QString();
+}
+//==============================================================================
+void Log::startLog(const QString &fileName)
+{
+    if(m_logDir.right(1) != directorySeparator)
+        m_logDir += directorySeparator;
+
+    m_startTime = QDateTime::currentDateTime();
+
+    if(fileName.isEmpty()) {
+        m_fileName = generateLogFileName(m_logDir, m_startTime);
+    }
+    else {
+        m_fileName = fileName;
+    }
+
+    if(!makePath(m_logDir)) {
+        m_lastError = tr("Failed to create folder \"%1\"").arg(m_logDir);
+        emit error(m_lastError);
+        return;
+    }
+
+    m_file.setFileName(m_logDir + m_fileName);
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        m_lastError = tr("Failed to create file \"%1\"").arg(m_file.fileName());
+        emit error(m_lastError);
+        return;
+    }
+
+    emit openFile(m_file.fileName());
+    m_stream.setDevice(&m_file);
+
+    if(!writeFirstLine()) {
+        emit error(m_lastError);
+    }
+}
+//==============================================================================
+bool Log::writeFirstLine()
+{
+    if(!m_file.isOpen()) {
+        m_lastError = tr("Log file is not open");
+        return false;
+    }
+
+    // Not subject to rate limits or sampling, a log always has its borders
+    QString logStr = "----- " + tr("Begin") + " -----";
+    writeMessage(currentTime(), 0, logStr.leftJustified(100,'-'), LogInfo);
+    return true;
+}
+//==============================================================================
+bool Log::writeLastLine()
+{
+    if(!m_file.isOpen()) {
+        m_lastError = tr("Log file is not open");
+        return false;
     }
 
     QDateTime now = (m_startTime.offsetFromUtc() != 0)
             ? QDateTime::currentDateTime()
             : QDateTime::currentDateTimeUtc();
-    QString prefix = getLogPrefix(logType, now);
-    QStringList sl = text.split("\n");
+    qint64 n = now.toMSecsSinceEpoch() - m_startTime.toMSecsSinceEpoch();
+    QString logStr = "----- " + tr("End") + ". " + tr("Working time:")
+            + " " + QString::number(n) + " " + tr("msec") +". -----";
+
+    writeMessage(currentTime(), 0, logStr.leftJustified(100,'-'), LogInfo);
+    return true;
+}
+//==============================================================================
+void Log::saveToLog(const QString &text, LogType logType)
+{
+    saveSourceToLog(0, text, logType);
+}
+//==============================================================================
+void Log::saveSourceToLog(quint16 sourceId, const QString &text, LogType logType)
+{
+    if((logType == LogDbg) && !m_dbgSave) return;
+
+    QString repeatNote;
+    if(m_limiting.load(std::memory_order_relaxed) && !admit(sourceId, text, logType, repeatNote)) return;
+
+    const QDateTime now = currentTime();
+
+    if(!repeatNote.isEmpty()) writeMessage(now, sourceId, repeatNote, logType);
+    writeMessage(now, sourceId, text, logType);
+}
+//==============================================================================
+void Log::writeMessage(const QDateTime &now, quint16 sourceId, const QString &text, LogType logType)
+{
+    if(m_async.load(std::memory_order_acquire)) {
+
+        // The busy flag is raised before m_async is checked again, so
+        // stopWriter() either sees this push in flight or we see it stopped
+        Stage *stage = currentStage();
+        stage->busy.store(true);
+
+        if(m_async.load()) {
+
+            // The writer thread already reported the failure and closed the file
+            if(m_writerFailed.load(std::memory_order_relaxed)) {
+                stage->busy.store(false, std::memory_order_release);
+                return;
+            }
+
+            Record *record = new Record;
+            record->order = std::chrono::steady_clock::now().time_since_epoch().count();
+            record->time = now;
+            record->logType = logType;
+            record->sourceId = sourceId;
+            record->text = text;
+
+            std::atomic<Record*> &queue = stage->queue;
+            record->next = queue.load(std::memory_order_relaxed);
+
+            while(!queue.compare_exchange_weak(record->next, record,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {}
+
+            stage->busy.store(false, std::memory_order_release);
+
+            // An error is on disk when saveToLog() returns, as in sync mode
+            if(logType == LogError) {
+                const quint64 request = m_flushRequests.fetch_add(1) + 1;
+                m_wake.release();
+                waitForFlush(request);
+            }
+            return;
+        }
+
+        stage->busy.store(false, std::memory_order_relaxed);
+    }
+
+    bool notify = false;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if(!m_file.isOpen()) {
+            m_lastError = tr("Log file is not open");
+            postNotice(NoticeError, m_lastError);
+        }
+        else {
+
+            writeLines(now, text, logType, sourceId);
+
+            if (flushStream()) {
+                rotateIfNeeded(now);
+            }
+            else {
+                m_file.close();
+                m_lastError = tr("Error writing to file \"%1\"").arg(m_file.fileName());
+                postNotice(NoticeError, m_lastError);
+                postNotice(NoticeClose, m_file.fileName());
+            }
+        }
+
+        notify = !m_notices.isEmpty();
+    }
+
+    if(notify) emitNotices();
+}
+//==============================================================================
+void Log::flush()
+{
+    flushRepeats();
+    if(m_async) m_wake.release();
+}
+//==============================================================================
+bool Log::admit(quint16 sourceId, const QString &text, Log::LogType logType, QString &repeatNote)
+{
+    QMutexLocker locker(&m_limitMutex);
+
+    // Repeats of the previous message from the same source and type are
+    // only counted; a different message first gets a summary line
+    if(m_suppressDuplicates) {
+
+        Repeat &repeat = m_repeats[ (static_cast<quint32>(sourceId) << 8) | static_cast<quint32>(logType) ];
+        const uint hash = qHash(text);
+
+        if(repeat.seen && (repeat.hash == hash) && (repeat.text == text)) {
+            ++repeat.count;
+            ++m_duplicateCount;
+            return false;
+        }
+
+        if(repeat.count > 0) {
+            repeatNote = tr("Last message repeated %1 times").arg(repeat.count);
+        }
+
+        repeat.hash = hash;
+        repeat.text = text;
+        repeat.count = 0;
+        repeat.seen = true;
+    }
+
+    if(!m_limitClock.isValid()) m_limitClock.start();
+    const qint64 now = m_limitClock.nsecsElapsed();
+
+    const auto take = [now](Limit &limit) {
+
+        if((limit.sampling > 1) && ((limit.sampleCounter++ % static_cast<quint64>(limit.sampling)) != 0)) {
+            return false;
+        }
+
+        if(limit.rate <= 0.0) return true;
+
+        if(limit.last > 0) {
+            limit.tokens = qMin(limit.burst, limit.tokens + (now - limit.last) * limit.rate / 1e9);
+        }
+
+        limit.last = now;
+        if(limit.tokens < 1.0) return false;
+
+        limit.tokens -= 1.0;
+        return true;
+    };
+
+    Limit &typeLimit = m_typeLimits[logType];
+
+    if(!take(typeLimit)) {
+        ++typeLimit.suppressed;
+        return false;
+    }
+
+    auto it = m_sourceLimits.find(sourceId);
+
+    if((it != m_sourceLimits.end()) && !take(it.value())) {
+        ++it.value().suppressed;
+        return false;
+    }
+
+    return true;
+}
+//==============================================================================
+void Log::updateLimiting()
+{
+    bool limiting = m_suppressDuplicates;
+
+    for(const Limit &limit: m_typeLimits) {
+        limiting = limiting || (limit.rate > 0.0) || (limit.sampling > 1);
+    }
+
+    for(const Limit &limit: m_sourceLimits) {
+        limiting = limiting || (limit.rate > 0.0) || (limit.sampling > 1);
+    }
+
+    m_limiting = limiting;
+}
+//==============================================================================
+void Log::flushRepeats()
+{
+    struct Note {
+        quint16 sourceId;
+        LogType logType;
+        quint64 count;
+    };
+
+    QVector<Note> notes;
+
+    {
+        QMutexLocker locker(&m_limitMutex);
+
+        for(auto it = m_repeats.begin(); it != m_repeats.end(); ++it) {
+
+            if(it.value().count == 0) continue;
+
+            notes.append( { static_cast<quint16>(it.key() >> 8),
+                            static_cast<LogType>(it.key() & 0xFF),
+                            it.value().count } );
+            it.value().count = 0;
+        }
+    }
+
+    if(notes.isEmpty()) return;
+
+    const QDateTime now = currentTime();
+
+    for(const Note &note: notes) {
+        writeMessage(now, note.sourceId, tr("Last message repeated %1 times").arg(note.count),
+                     note.logType);
+    }
+}
+//==============================================================================
+void Log::rotate()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if(m_file.isOpen()) rotateFile( currentTime() );
+    }
+
+    emitNotices();
+}
+//==============================================================================
+void Log::scheduleRotation(const QDateTime &now)
+{
+    if(m_rotationInterval <= 0) {
+        m_nextRotation = 0;
+        return;
+    }
+
+    // Align to local wall-clock boundaries: hourly at hh:00, daily at midnight
+    const qint64 offset = now.offsetFromUtc();
+    const qint64 local = now.toSecsSinceEpoch() + offset;
+    m_nextRotation = (local / m_rotationInterval + 1) * m_rotationInterval - offset;
+}
+//==============================================================================
+void Log::rotateIfNeeded(const QDateTime &now)
+{
+    if(!m_file.isOpen()) return;
+
+    // Called after a flush, so the position is the file size
+    const qint64 size = writesText() ? m_file.pos() : m_binaryOffset;
+
+    if(((m_maxFileSize > 0) && (size >= m_maxFileSize))
+            || ((m_nextRotation > 0) && (now.toSecsSinceEpoch() >= m_nextRotation))) {
+        rotateFile(now);
+    }
+}
+//==============================================================================
+void Log::rotateFile(const QDateTime &now)
+{
+    // Runs under m_mutex, so no write can land between close and reopen
+    const QString rotatedFile = m_file.fileName();
+    const bool binary = m_binaryFile.isOpen();
+    QDateTime fileTime = now;
+    const QString fileName = generateLogFileName(m_logDir, fileTime);
+
+    QString logStr = "----- " + tr("Continued in") + " " + fileName + " -----";
+    writeLines(now, logStr.leftJustified(100,'-'), LogInfo, 0);
+    flushStream();
+    closeBinaryFile();
+    m_file.close();
+    postNotice(NoticeClose, rotatedFile);
+
+    m_fileName = fileName;
+    m_file.setFileName(m_logDir + m_fileName);
+    scheduleRotation(now);
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        m_lastError = tr("Failed to create file \"%1\"").arg(m_file.fileName());
+        postNotice(NoticeError, m_lastError);
+        return;
+    }
+
+    m_stream.setDevice(&m_file);
+    m_stream.resetStatus();
+    postNotice(NoticeOpen, m_file.fileName());
+
+    if(binary) openBinaryFile();
+
+    logStr = "----- " + tr("Continued from") + " " + extractFileName(rotatedFile) + " -----";
+    writeLines(now, logStr.leftJustified(100,'-'), LogInfo, 0);
+    flushStream();
+
+    LogHousekeeping *task = new LogHousekeeping;
+    task->logDir = m_logDir;
+    task->rotatedFile = rotatedFile;
+    task->currentGeneration = logGeneration(m_fileName);
+    task->compress = m_compressRotated;
+    task->maxFiles = m_maxFiles;
+    task->maxAge = m_maxAge;
+    task->maxTotalSize = m_maxTotalSize;
+    QThreadPool::globalInstance()->start(task);
+}
+//==============================================================================
+void Log::writeLines(const QDateTime &time, const QString &text, LogType logType, quint16 sourceId)
+{
+    static const QMetaMethod writeSignal = QMetaMethod::fromSignal(&Log::write);
+
+    if(m_binaryFile.isOpen()) {
+
+        const qint64 offset = m_binaryOffset + m_binaryBlock.size();
+        const qint64 timestamp = time.toMSecsSinceEpoch();
+
+        if((m_blockOffset >= 0) && ((m_blockCount >= static_cast<quint32>(m_indexRecords))
+                                    || (offset - m_blockOffset >= m_indexBytes))) {
+            closeIndexBlock();
+        }
+
+        if(m_blockOffset < 0) {
+            m_blockOffset = offset;
+            m_blockFirst = timestamp;
+            m_blockLast = timestamp;
+            m_blockCount = 0;
+            m_blockMask = 0;
+        }
+
+        m_blockFirst = qMin(m_blockFirst, timestamp);
+        m_blockLast = qMax(m_blockLast, timestamp);
+        m_blockMask |= 1u << static_cast<int>(logType);
+        ++m_blockCount;
+
+        const QByteArray payload = text.toUtf8();
+        char header[binaryRecordHeaderSize];
+
+        qToLittleEndian<qint64>(timestamp, header);
+        qToLittleEndian<qint16>(static_cast<qint16>(time.offsetFromUtc() / 60), header + 8);
+        qToLittleEndian<quint16>(sourceId, header + 10);
+        header[12] = static_cast<char>(logType);
+        std::memset(header + 13, 0, 3);
+        qToLittleEndian<quint32>(static_cast<quint32>(payload.size()), header + 16);
+
+        m_binaryBlock.append(header, binaryRecordHeaderSize);
+        m_binaryBlock.append(payload);
+    }
+
+    const bool writeText = writesText();
+    const bool notify = isSignalConnected(writeSignal);
+    if(!writeText && !notify) return;
+
+    const QString prefix = getLogPrefix(logType, time);
+    int from = 0;
+
+    forever {
+
+        const int to = text.indexOf(QLatin1Char('\n'), from);
+        const QStringRef line = text.midRef(from, (to < 0 ? text.size() : to) - from);
+
+        if(writeText) m_stream << prefix << line << '\n';
+
+        if(notify) {
+            QString str = prefix;
+            str.append(line);
+            postNotice(NoticeWrite, str);
+        }
+
+        if(to < 0) break;
+        from = to + 1;
+    }
+}
+//==============================================================================
+bool Log::flushStream()
+{
+    if(m_binaryFile.isOpen() && !m_binaryBlock.isEmpty()) {
 
-    for(int i=0; i < sl.size(); i++) {
+        const bool ok = (m_binaryFile.write(m_binaryBlock) == m_binaryBlock.size())
+                && m_binaryFile.flush();
+        m_binaryOffset += m_binaryBlock.size();
+        m_binaryBlock.resize(0);
 
-        QString str = prefix + sl.at(i);
-        m_stream << str << "\n";
-        emit write(str);
+        if(!ok) {
+            m_binaryFile.close();
+            m_indexFile.close();
+            m_lastError = tr("Error writing to file \"%1\"").arg(m_binaryFile.fileName());
+            postNotice(NoticeError, m_lastError);
+        }
+    }
+
+    // Entries only point at data already written above
+    if(m_indexFile.isOpen() && !m_indexBlock.isEmpty()) {
+
+        const bool ok = (m_indexFile.write(m_indexBlock) == m_indexBlock.size())
+                && m_indexFile.flush();
+        m_indexBlock.resize(0);
+
+        if(!ok) {
+            m_indexFile.close();
+            m_lastError = tr("Error writing to file \"%1\"").arg(m_indexFile.fileName());
+            postNotice(NoticeError, m_lastError);
+        }
     }
 
     m_stream.flush();
     m_file.flush();
+    return m_stream.status() == QTextStream::Ok;
+}
+//==============================================================================
+bool Log::writesText() const
+{
+    // A binary log closed on a write error brings the text output back
+    return m_textLog || !m_binaryFile.isOpen();
+}
+//==============================================================================
+void Log::postNotice(Log::Notice notice, const QString &text)
+{
+    // A slot reading lastError() or logging again would deadlock on
+    // m_mutex, so signals wait in m_notices until emitNotices()
+    m_notices.append( qMakePair(notice, text) );
+}
+//==============================================================================
+void Log::emitNotices()
+{
+    QVector<QPair<Notice, QString>> notices;
 
-    if (m_stream.status() != QTextStream::Ok) {
-        m_file.close();
-        m_lastError = tr("Error writing to file \"%1\"").arg(m_file.fileName());
-        emit error(m_lastError);
-        emit closeFile(m_file.fileName());
+    {
+        QMutexLocker locker(&m_mutex);
+        if(m_notices.isEmpty()) return;
+        notices.swap(m_notices);
     }
+
+    for(const QPair<Notice, QString> &notice: notices) {
+
+        switch (notice.first) {
+        case NoticeOpen:  emit openFile(notice.second); break;
+        case NoticeClose: emit closeFile(notice.second); break;
+        case NoticeError: emit error(notice.second); break;
+        case NoticeWrite: emit write(notice.second); break;
+        }
+    }
+}
+//==============================================================================
+bool Log::openBinaryFile()
+{
+    m_binaryFile.setFileName( changeFileExt(m_file.fileName(), "nlog") );
+
+    if (!m_binaryFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_lastError = tr("Failed to create file \"%1\"").arg(m_binaryFile.fileName());
+        postNotice(NoticeError, m_lastError);
+        return false;
+    }
+
+    char header[binaryHeaderSize];
+    std::memcpy(header, binaryMagic().constData(), 4);
+    qToLittleEndian<quint16>(binaryFormatVersion, header + 4);
+    qToLittleEndian<quint16>(0, header + 6);
+
+    m_binaryBlock.clear();
+    m_binaryBlock.append(header, binaryHeaderSize);
+    m_binaryOffset = 0;
+    m_blockOffset = -1;
+
+    m_indexFile.setFileName( changeFileExt(m_file.fileName(), "nidx") );
+    m_indexBlock.clear();
+
+    if (!m_indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        m_lastError = tr("Failed to create file \"%1\"").arg(m_indexFile.fileName());
+        postNotice(NoticeError, m_lastError);
+        return true;
+    }
+
+    std::memcpy(header, indexMagic().constData(), 4);
+    m_indexBlock.append(header, binaryHeaderSize);
+    return true;
+}
+//==============================================================================
+void Log::closeBinaryFile()
+{
+    if(!m_binaryFile.isOpen()) return;
+
+    closeIndexBlock();
+    flushStream();
+    m_binaryFile.close();
+    m_indexFile.close();
+}
+//==============================================================================
+void Log::closeIndexBlock()
+{
+    if(m_blockOffset < 0) return;
+
+    const qint64 end = m_binaryOffset + m_binaryBlock.size();
+    char entry[indexEntrySize];
+
+    qToLittleEndian<qint64>(m_blockOffset, entry);
+    qToLittleEndian<quint32>(static_cast<quint32>(end - m_blockOffset), entry + 8);
+    qToLittleEndian<quint32>(m_blockCount, entry + 12);
+    qToLittleEndian<qint64>(m_blockFirst, entry + 16);
+    qToLittleEndian<qint64>(m_blockLast, entry + 24);
+    qToLittleEndian<quint32>(m_blockMask, entry + 32);
+    qToLittleEndian<quint32>(0, entry + 36);
+
+    m_indexBlock.append(entry, indexEntrySize);
+    m_blockOffset = -1;
+}
+//==============================================================================
+quint64 Log::nextInstanceId()
+{
+    static std::atomic<quint64> counter {0};
+    return ++counter;
+}
+//==============================================================================
+Log::Stage *Log::currentStage()
+{
+    // One-entry cache per thread, keyed by instance so a new Log at the
+    // same address never picks up a stale stage
+    static thread_local quint64 cachedInstance {0};
+    static thread_local Stage *cachedStage {nullptr};
+
+    if(cachedInstance == m_instanceId) return cachedStage;
+
+    const Qt::HANDLE threadId = QThread::currentThreadId();
+    Stage *stage = m_stages.load(std::memory_order_acquire);
+
+    while(stage && (stage->threadId != threadId)) {
+        stage = stage->next;
+    }
+
+    if(!stage) {
+
+        stage = new Stage;
+        stage->threadId = threadId;
+        stage->next = m_stages.load(std::memory_order_relaxed);
+
+        while(!m_stages.compare_exchange_weak(stage->next, stage,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {}
+    }
+
+    cachedInstance = m_instanceId;
+    cachedStage = stage;
+    return stage;
+}
+//==============================================================================
+QVector<Log::Record*> Log::takeRecords()
+{
+    QVector<Record*> records;
+
+    for(Stage *stage = m_stages.load(std::memory_order_acquire); stage; stage = stage->next) {
+
+        const int first = records.size();
+        Record *record = stage->queue.exchange(nullptr, std::memory_order_acquire);
+
+        for(; record; record = record->next) {
+            records.append(record);
+        }
+
+        // Producers push to the front, restore arrival order of the thread
+        std::reverse(records.begin() + first, records.end());
+    }
+
+    // Each thread's run is already ordered, merge them by timestamp
+    std::stable_sort(records.begin(), records.end(), [](const Record *a, const Record *b) {
+        return a->order < b->order;
+    });
+
+    return records;
+}
+//==============================================================================
+bool Log::writeRecords(const QVector<Log::Record*> &records)
+{
+    bool ok = !m_writerFailed;
+
+    for(Record *record: records) {
+        if(ok) writeLines(record->time, record->text, record->logType, record->sourceId);
+        delete record;
+    }
+
+    return ok && flushStream();
+}
+//==============================================================================
+void Log::writerLoop()
+{
+    bool stop = false;
+
+    while(!stop) {
+
+        // Sleep one flush interval unless an error message or flush() wakes us
+        m_wake.tryAcquire(1, m_flushInterval.load(std::memory_order_relaxed));
+        m_wake.tryAcquire(m_wake.available());
+        stop = m_writerStop.load(std::memory_order_acquire);
+
+        // Requests are counted after their record is queued, so all of
+        // them up to this value are in the records taken below
+        const quint64 request = m_flushRequests.load();
+        const QVector<Record*> records = takeRecords();
+
+        if(records.isEmpty()) {
+            releaseFlush(request);
+            continue;
+        }
+
+        bool notify = false;
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            if(writeRecords(records)) {
+                rotateIfNeeded( currentTime() );
+            }
+            else if(!m_writerFailed) {
+
+                m_writerFailed = true;
+                m_file.close();
+
+                QMetaObject::invokeMethod(this, [this]() {
+                    {
+                        QMutexLocker locker(&m_mutex);
+                        m_lastError = tr("Error writing to file \"%1\"").arg(m_file.fileName());
+                        postNotice(NoticeError, m_lastError);
+                        postNotice(NoticeClose, m_file.fileName());
+                    }
+
+                    emitNotices();
+                }, Qt::QueuedConnection);
+            }
+
+            notify = !m_notices.isEmpty();
+        }
+
+        releaseFlush(request);
+        if(notify) emitNotices();
+    }
+}
+//==============================================================================
+void Log::stopWriter()
+{
+    if(!m_writerThread) return;
+
+    m_async = false;
+
+    // A producer that saw m_async set may still be pushing its record
+    for(Stage *stage = m_stages.load(); stage; stage = stage->next) {
+        while(stage->busy.load()) QThread::yieldCurrentThread();
+    }
+
+    m_writerStop = true;
+    m_wake.release();
+    m_writerThread->wait();
+    delete m_writerThread;
+    m_writerThread = nullptr;
+
+    // Messages queued while the writer was exiting
+    const quint64 request = m_flushRequests.load();
+    const QVector<Record*> records = takeRecords();
+
+    if(records.isEmpty()) {
+        releaseFlush(request);
+        return;
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if(!writeRecords(records) && m_file.isOpen()) {
+            m_file.close();
+            m_lastError = tr("Error writing to file \"%1\"").arg(m_file.fileName());
+            postNotice(NoticeError, m_lastError);
+            postNotice(NoticeClose, m_file.fileName());
+        }
+    }
+
+    releaseFlush(request);
+    emitNotices();
+}
+//==============================================================================
+void Log::waitForFlush(quint64 request)
+{
+    // The writer itself (e.g. a slot of write()) must not wait for itself
+    if(QThread::currentThread() == m_writerThread) return;
+
+    QMutexLocker locker(&m_flushMutex);
+
+    while(m_flushedRequests < request) {
+        m_flushed.wait(&m_flushMutex);
+    }
+}
+//==============================================================================
+void Log::releaseFlush(quint64 request)
+{
+    QMutexLocker locker(&m_flushMutex);
+    if(request <= m_flushedRequests) return;
+
+    m_flushedRequests = request;
+    m_flushed.wakeAll();
+}
+//==============================================================================
+bool Log::selfTest(const QString &logDir, QString *errorString)
+{
+    const QString dirName = selfTestDir(logDir, "rotation");
+    const int maxFiles = 3;
+
+    // A file Log did not generate, retention must leave it alone
+    if(!QDir().mkpath(dirName)) {
+        return selfTestFailed(errorString, QString("Failed to create folder \"%1\"").arg(dirName));
+    }
+
+    QFile foreign(dirName + "/foreign.log");
+    if(!foreign.open(QIODevice::WriteOnly)) return selfTestFailed(errorString, foreign.errorString());
+    foreign.close();
+
+    {
+        Log log(dirName);
+        if(!log.setBinaryLog()) return selfTestFailed(errorString, log.lastError());
+
+        log.setMaxFileSize(4096);
+        log.setRetention(maxFiles);
+        log.setCompressRotated();
+
+        for(int n = 0; n < 400; ++n) {
+            log.saveToLog( QString("message %1 ").arg(n).leftJustified(100, 'x') );
+        }
+    }
+
+    QThreadPool::globalInstance()->waitForDone();
+
+    const QDir dir(dirName);
+    if(!dir.exists("foreign.log")) return selfTestFailed(errorString, "Retention removed foreign.log");
+
+    const QStringList texts = dir.entryList( { "*.log", "*.log.gz" }, QDir::Files, QDir::Name );
+    const QStringList binaries = dir.entryList( { "*.nlog" }, QDir::Files, QDir::Name );
+    const QStringList indexes = dir.entryList( { "*.nidx" }, QDir::Files, QDir::Name );
+
+    // One text file per generation, plus foreign.log
+    if((texts.size() - 1 > maxFiles) || (texts.size() < 3)) {
+        return selfTestFailed(errorString, QString("%1 text log generations left, expected 2..%2")
+                              .arg(texts.size() - 1).arg(maxFiles));
+    }
+    if((binaries.size() != texts.size() - 1) || (indexes.size() != binaries.size())) {
+        return selfTestFailed(errorString, QString("%1 text, %2 binary and %3 index files left")
+                              .arg(texts.size() - 1).arg(binaries.size()).arg(indexes.size()));
+    }
+    if(!dir.entryList( { "*.nlog.gz", "*.nidx.gz", "*.tmp" }, QDir::Files).isEmpty()) {
+        return selfTestFailed(errorString, "Binary log compressed or temporary file left");
+    }
+
+    for(const QString &name: texts) {
+
+        if(!name.endsWith(".gz")) continue;
+
+        QFile file(dir.absoluteFilePath(name));
+        const QByteArray header = file.open(QIODevice::ReadOnly) ? file.read(2) : QByteArray();
+        if(header != QByteArray("\x1f\x8b", 2)) {
+            return selfTestFailed(errorString, QString("%1 is not a gzip file").arg(name));
+        }
+    }
+
+    // Binary logs stay uncompressed, LogReader must still recognize them
+    for(const QString &name: binaries) {
+
+        QFile file(dir.absoluteFilePath(name));
+        const QByteArray magic = file.open(QIODevice::ReadOnly) ? file.read(4) : QByteArray();
+        if(magic != binaryMagic()) {
+            return selfTestFailed(errorString, QString("%1 is not a binary log").arg(name));
+        }
+    }
+
+    return true;
 }
 //==============================================================================
 
@@ -0,0 +1,259 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <atomic>
+#include <limits>
+
+#include "log_benchmark.h"
+#include "log_reader.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+LogBenchmark::LogBenchmark(Log *log)
+    : m_log {log}
+{
+}
+//==============================================================================
+Log *LogBenchmark::log() const
+{
+    return m_log;
+}
+//==============================================================================
+void LogBenchmark::setLog(Log *log)
+{
+    m_log = log;
+}
+//==============================================================================
+int LogBenchmark::threads() const
+{
+    return m_threads;
+}
+//==============================================================================
+void LogBenchmark::setThreads(int threads)
+{
+    m_threads = qMax(1, threads);
+}
+//==============================================================================
+int LogBenchmark::messages() const
+{
+    return m_messages;
+}
+//==============================================================================
+void LogBenchmark::setMessages(int messages)
+{
+    m_messages = qMax(1, messages);
+}
+//==============================================================================
+int LogBenchmark::messageSize() const
+{
+    return m_messageSize;
+}
+//==============================================================================
+void LogBenchmark::setMessageSize(int messageSize)
+{
+    m_messageSize = qMax(1, messageSize);
+}
+//==============================================================================
+LogBenchmark::Result LogBenchmark::run()
+{
+    Result result;
+    if(!m_log) return result;
+
+    Log *log = m_log;
+    const int messages = m_messages;
+    const QString text(m_messageSize, QChar('x'));
+
+    QVector<QThread*> threads;
+    QVector<qint64> callTotal(m_threads, 0);
+    QVector<qint64> callMax(m_threads, 0);
+    std::atomic<int> ready {0};
+    std::atomic<bool> go {false};
+
+    for(int i = 0; i < m_threads; ++i) {
+
+        threads.append( QThread::create([=, &callTotal, &callMax, &ready, &go]() {
+
+            const QString prefix = QString("T%1 ").arg(i);
+            QElapsedTimer timer;
+            qint64 total = 0;
+            qint64 maximum = 0;
+
+            ready.fetch_add(1);
+            while(!go.load(std::memory_order_acquire)) QThread::yieldCurrentThread();
+
+            for(int n = 0; n < messages; ++n) {
+
+                timer.start();
+                log->saveToLog(prefix + text, Log::LogInfo);
+
+                const qint64 nsec = timer.nsecsElapsed();
+                total += nsec;
+                maximum = qMax(maximum, nsec);
+            }
+
+            callTotal[i] = total;
+            callMax[i] = maximum;
+        }) );
+
+        threads.last()->start();
+    }
+
+    while(ready.load() < m_threads) QThread::yieldCurrentThread();
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    go.store(true, std::memory_order_release);
+
+    for(QThread *thread: threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    result.elapsed = elapsed.nsecsElapsed();
+    result.threads = m_threads;
+    result.messages = static_cast<qint64>(m_threads) * messages;
+
+    qint64 total = 0;
+
+    for(int i = 0; i < m_threads; ++i) {
+        total += callTotal.at(i);
+        result.callMax = qMax(result.callMax, callMax.at(i));
+    }
+
+    result.callAverage = total / result.messages;
+    if(result.elapsed > 0) {
+        result.messagesPerSecond = result.messages * 1e9 / result.elapsed;
+    }
+
+    log->flush();
+    return result;
+}
+//==============================================================================
+LogBenchmark::FormatResult LogBenchmark::runFormat(int lines) const
+{
+    FormatResult result;
+    result.lines = qMax(1, lines);
+
+    const QString text(m_messageSize, QChar('x'));
+    QElapsedTimer timer;
+    qint64 size = 0;
+
+    timer.start();
+
+    for(qint64 n = 0; n < result.lines; ++n) {
+
+        const QDateTime now = QDateTime::currentDateTime();
+        const QString prefix = now.toString("[HH:mm:ss.zzz]") + Log::getLogTypeStr(Log::LogInfo) + " ";
+        const QStringList sl = text.split("\n");
+        size += (prefix + sl.at(0)).size();
+    }
+
+    qint64 elapsed = qMax<qint64>(1, timer.nsecsElapsed());
+    result.legacyLinesPerSecond = result.lines * 1e9 / elapsed;
+
+    timer.start();
+
+    for(qint64 n = 0; n < result.lines; ++n) {
+
+        QString line = Log::getLogPrefix(Log::LogInfo, Log::currentTime());
+        line.append(text);
+        size += line.size();
+    }
+
+    elapsed = qMax<qint64>(1, timer.nsecsElapsed());
+    result.linesPerSecond = result.lines * 1e9 / elapsed;
+
+    // Keep the loops from being optimized away
+    if(size < 0) result.lines = 0;
+    return result;
+}
+//==============================================================================
+LogBenchmark::IndexResult LogBenchmark::runIndex(const QString &logDir, qint64 totalBytes,
+                                                 int errorEvery) const
+{
+    IndexResult result;
+    errorEvery = qMax(1, errorEvery);
+
+    const QString text(m_messageSize, QChar('x'));
+    const qint64 recordSize = Log::binaryRecordHeaderSize + m_messageSize;
+    const qint64 records = qMax<qint64>(1, totalBytes / recordSize);
+    qint64 windowFrom = 0;
+    QString fileName;
+
+    {
+        Log log(logDir);
+        if(!log.setBinaryLog()) return result;
+
+        fileName = log.binaryFileName();
+
+        for(qint64 n = 0; n < records; ++n) {
+
+            if(n == records / 2) windowFrom = Log::currentTime().toMSecsSinceEpoch();
+
+            const Log::LogType logType = (n % errorEvery == errorEvery - 1)
+                    ? Log::LogError
+                    : ((n % 10 == 0) ? Log::LogIn : Log::LogOut);
+            log.saveSourceToLog(static_cast<quint16>(n % 4), text, logType);
+        }
+    }
+
+    result.fileSize = QFile(fileName).size();
+    result.records = records;
+
+    LogReader reader;
+    if(!reader.open(fileName)) return result;
+
+    const qint64 windowTo = windowFrom + 1000;
+    const quint32 errorMask = LogReader::typeMask(Log::LogError);
+    QElapsedTimer timer;
+
+    reader.setUseIndex(false);
+    timer.start();
+    result.errors = reader.query(std::numeric_limits<qint64>::min(),
+                                 std::numeric_limits<qint64>::max(), errorMask).size();
+    result.scanTime = timer.elapsed();
+
+    timer.start();
+    reader.query(windowFrom, windowTo);
+    result.windowScanTime = timer.elapsed();
+
+    reader.setUseIndex(true);
+    timer.start();
+    reader.query(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), errorMask);
+    result.indexedTime = timer.elapsed();
+
+    timer.start();
+    reader.query(windowFrom, windowTo);
+    result.windowIndexedTime = timer.elapsed();
+
+    return result;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
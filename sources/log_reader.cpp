@@ -0,0 +1,507 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QDir>
+#include <QTextStream>
+#include <QtEndian>
+#include <limits>
+
+#include "FileSys"
+#include "log_reader.h"
+
+namespace nayk { //=============================================================
+
+const quint32 LogReader::allTypes;
+
+//------------------------------------------------------------------------------
+static bool selfTestFailed(QString *errorString, const QString &text)
+{
+    if(errorString) *errorString = QString("LogReader: %1").arg(text);
+    return false;
+}
+//------------------------------------------------------------------------------
+static QString selfTestDir(const QString &logDir, const QString &name)
+{
+    return QDir(logDir).absoluteFilePath( QString("%1_%2").arg(name)
+                                          .arg(QDateTime::currentMSecsSinceEpoch()) );
+}
+//==============================================================================
+QDateTime LogReader::Record::time() const
+{
+    return QDateTime::fromMSecsSinceEpoch(timestamp, Qt::OffsetFromUTC, utcOffset);
+}
+//==============================================================================
+QStringList LogReader::Record::toText() const
+{
+    const QString prefix = Log::getLogPrefix(logType, time());
+    QStringList lines = text.split("\n");
+
+    for(int i = 0; i < lines.size(); ++i) {
+        lines[i].prepend(prefix);
+    }
+
+    return lines;
+}
+//==============================================================================
+LogReader::LogReader(QObject *parent) : QObject(parent)
+{
+}
+//==============================================================================
+QString LogReader::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool LogReader::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly)) {
+        m_lastError = tr("Failed to open log file '%1': %2")
+                .arg(fileName)
+                .arg(m_file.errorString());
+        return false;
+    }
+
+    const QByteArray header = m_file.read(Log::binaryHeaderSize);
+
+    if((header.size() != Log::binaryHeaderSize)
+            || !header.startsWith(Log::binaryMagic())
+            || (qFromLittleEndian<quint16>(header.constData() + 4) != Log::binaryFormatVersion)) {
+
+        m_lastError = tr("'%1' is not a supported binary log file").arg(fileName);
+        m_file.close();
+        return false;
+    }
+
+    m_bufferOffset = Log::binaryHeaderSize;
+    m_recordCount = 0;
+    m_block = 0;
+    loadIndex( file_sys::changeFileExt(fileName, "nidx") );
+    return true;
+}
+//==============================================================================
+void LogReader::close()
+{
+    m_file.close();
+    m_buffer.clear();
+    m_bufferPos = 0;
+    m_bufferOffset = 0;
+    m_index.clear();
+    m_block = 0;
+}
+//==============================================================================
+bool LogReader::isOpen() const
+{
+    return m_file.isOpen();
+}
+//==============================================================================
+int LogReader::sourceFilter() const
+{
+    return m_sourceFilter;
+}
+//==============================================================================
+void LogReader::setSourceFilter(int sourceId)
+{
+    m_sourceFilter = sourceId;
+}
+//==============================================================================
+quint32 LogReader::typeFilter() const
+{
+    return m_typeFilter;
+}
+//==============================================================================
+void LogReader::setTypeFilter(quint32 mask)
+{
+    m_typeFilter = mask;
+}
+//==============================================================================
+qint64 LogReader::timeFrom() const
+{
+    return m_timeFrom;
+}
+//==============================================================================
+qint64 LogReader::timeTo() const
+{
+    return m_timeTo;
+}
+//==============================================================================
+void LogReader::setTimeRange(qint64 from, qint64 to)
+{
+    m_timeFrom = from;
+    m_timeTo = to;
+}
+//==============================================================================
+bool LogReader::useIndex() const
+{
+    return m_useIndex;
+}
+//==============================================================================
+void LogReader::setUseIndex(bool useIndex)
+{
+    m_useIndex = useIndex;
+}
+//==============================================================================
+bool LogReader::hasIndex() const
+{
+    return !m_index.isEmpty();
+}
+//==============================================================================
+QVector<LogReader::IndexEntry> LogReader::index() const
+{
+    return m_index;
+}
+//==============================================================================
+quint64 LogReader::recordCount() const
+{
+    return m_recordCount;
+}
+//==============================================================================
+bool LogReader::rewind()
+{
+    m_block = 0;
+    return seek(Log::binaryHeaderSize);
+}
+//==============================================================================
+bool LogReader::seekTime(qint64 timestamp)
+{
+    if(!m_useIndex || m_index.isEmpty()) return rewind();
+
+    // Blocks that end before the timestamp hold nothing of interest,
+    // even if the wall clock stepped back inside the log
+    for(int i = 0; i < m_index.size(); ++i) {
+
+        if(m_index.at(i).last < timestamp) continue;
+
+        m_block = i;
+        return seek(m_index.at(i).offset);
+    }
+
+    const IndexEntry &entry = m_index.last();
+    m_block = m_index.size();
+    return seek(entry.offset + entry.size);
+}
+//==============================================================================
+bool LogReader::readRecord(LogReader::Record &record, bool withText)
+{
+    forever {
+
+        if(!m_file.isOpen()) return false;
+
+        if(m_useIndex && !m_index.isEmpty()) {
+
+            const qint64 pos = m_bufferOffset + m_bufferPos;
+
+            while((m_block < m_index.size()) && (m_index.at(m_block).offset < pos)) {
+                ++m_block;
+            }
+
+            if((m_block < m_index.size()) && (m_index.at(m_block).offset == pos)
+                    && !blockMatches(m_index.at(m_block))) {
+
+                const IndexEntry &entry = m_index.at(m_block++);
+                if(!seek(entry.offset + entry.size)) return false;
+                continue;
+            }
+        }
+
+        if(!fill(Log::binaryRecordHeaderSize)) {
+            // Clean end of file only on a record boundary
+            if(m_bufferPos < m_buffer.size()) {
+                m_lastError = tr("Truncated record in log file '%1'").arg(m_file.fileName());
+            }
+            return false;
+        }
+
+        const char *header = m_buffer.constData() + m_bufferPos;
+        const quint32 size = qFromLittleEndian<quint32>(header + 16);
+
+        record.timestamp = qFromLittleEndian<qint64>(header);
+        record.utcOffset = qFromLittleEndian<qint16>(header + 8) * 60;
+        record.sourceId = qFromLittleEndian<quint16>(header + 10);
+        record.logType = static_cast<Log::LogType>(static_cast<quint8>(header[12]));
+
+        if((size > static_cast<quint32>(std::numeric_limits<int>::max() - Log::binaryRecordHeaderSize))
+                || !fill(Log::binaryRecordHeaderSize + static_cast<int>(size))) {
+            m_lastError = tr("Truncated record in log file '%1'").arg(m_file.fileName());
+            return false;
+        }
+
+        const char *payload = m_buffer.constData() + m_bufferPos + Log::binaryRecordHeaderSize;
+        m_bufferPos += Log::binaryRecordHeaderSize + static_cast<int>(size);
+
+        if((m_sourceFilter >= 0) && (static_cast<int>(record.sourceId) != m_sourceFilter)) continue;
+        if(!(typeMask(record.logType) & m_typeFilter)) continue;
+        if((record.timestamp < m_timeFrom) || (record.timestamp > m_timeTo)) continue;
+
+        if(withText) {
+            record.text = QString::fromUtf8(payload, static_cast<int>(size));
+        }
+        else {
+            record.text.clear();
+        }
+
+        ++m_recordCount;
+        return true;
+    }
+}
+//==============================================================================
+QVector<LogReader::Record> LogReader::query(qint64 from, qint64 to, quint32 typeMask,
+                                            int maxRecords)
+{
+    QVector<Record> records;
+
+    setTimeRange(from, to);
+    setTypeFilter(typeMask);
+    if(!seekTime(from)) return records;
+
+    Record record;
+
+    while(((maxRecords < 0) || (records.size() < maxRecords)) && readRecord(record)) {
+        records.append(record);
+    }
+
+    return records;
+}
+//==============================================================================
+quint32 LogReader::typeMask(Log::LogType logType)
+{
+    return 1u << static_cast<int>(logType);
+}
+//==============================================================================
+bool LogReader::convertToText(const QString &binaryFileName, const QString &textFileName,
+                              QString *errorString)
+{
+    LogReader reader;
+
+    if(!reader.open(binaryFileName)) {
+        if(errorString) *errorString = reader.lastError();
+        return false;
+    }
+
+    QFile file(textFileName);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate)) {
+        if(errorString) {
+            *errorString = tr("Failed to create file \"%1\"").arg(textFileName);
+        }
+        return false;
+    }
+
+    QTextStream stream(&file);
+    Record record;
+
+    while(reader.readRecord(record)) {
+        for(const QString &line: record.toText()) {
+            stream << line << "\n";
+        }
+    }
+
+    stream.flush();
+
+    if(!reader.lastError().isEmpty() || (stream.status() != QTextStream::Ok)) {
+        if(errorString) {
+            *errorString = reader.lastError().isEmpty()
+                    ? tr("Error writing to file \"%1\"").arg(textFileName)
+                    : reader.lastError();
+        }
+        return false;
+    }
+
+    return true;
+}
+//==============================================================================
+bool LogReader::fill(int size)
+{
+    if(m_buffer.size() - m_bufferPos >= size) return true;
+
+    m_buffer.remove(0, m_bufferPos);
+    m_bufferOffset += m_bufferPos;
+    m_bufferPos = 0;
+
+    const int oldSize = m_buffer.size();
+    const int count = qMax(size - oldSize, defaultBlockSize);
+
+    m_buffer.resize(oldSize + count);
+    const qint64 readCount = m_file.read(m_buffer.data() + oldSize, count);
+    m_buffer.resize(oldSize + static_cast<int>(qMax<qint64>(readCount, 0)));
+
+    return m_buffer.size() >= size;
+}
+//==============================================================================
+bool LogReader::seek(qint64 offset)
+{
+    if((offset >= m_bufferOffset) && (offset <= m_bufferOffset + m_buffer.size())) {
+        m_bufferPos = static_cast<int>(offset - m_bufferOffset);
+        return true;
+    }
+
+    m_buffer.clear();
+    m_bufferPos = 0;
+    m_bufferOffset = offset;
+    return m_file.seek(offset);
+}
+//==============================================================================
+bool LogReader::loadIndex(const QString &fileName)
+{
+    m_index.clear();
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)) return false;
+
+    const QByteArray data = file.readAll();
+
+    if((data.size() < Log::binaryHeaderSize)
+            || !data.startsWith(Log::indexMagic())
+            || (qFromLittleEndian<quint16>(data.constData() + 4) != Log::binaryFormatVersion)) {
+        return false;
+    }
+
+    const qint64 fileSize = m_file.size();
+    qint64 end = Log::binaryHeaderSize;
+    m_index.reserve((data.size() - Log::binaryHeaderSize) / Log::indexEntrySize);
+
+    for(int pos = Log::binaryHeaderSize; pos + Log::indexEntrySize <= data.size();
+        pos += Log::indexEntrySize) {
+
+        const char *entry = data.constData() + pos;
+        IndexEntry item;
+
+        item.offset = qFromLittleEndian<qint64>(entry);
+        item.size = qFromLittleEndian<quint32>(entry + 8);
+        item.count = qFromLittleEndian<quint32>(entry + 12);
+        item.first = qFromLittleEndian<qint64>(entry + 16);
+        item.last = qFromLittleEndian<qint64>(entry + 24);
+        item.typeMask = qFromLittleEndian<quint32>(entry + 32);
+
+        // A stale or foreign index is worse than none
+        if((item.offset < end) || (item.offset + item.size > fileSize)) {
+            m_index.clear();
+            return false;
+        }
+
+        end = item.offset + item.size;
+        m_index.append(item);
+    }
+
+    return true;
+}
+//==============================================================================
+bool LogReader::blockMatches(const LogReader::IndexEntry &entry) const
+{
+    return (entry.typeMask & m_typeFilter)
+            && (entry.last >= m_timeFrom)
+            && (entry.first <= m_timeTo);
+}
+//==============================================================================
+bool LogReader::selfTest(const QString &logDir, QString *errorString)
+{
+    struct Expected {
+        Log::LogType logType;
+        quint16 sourceId;
+        QString text;
+    };
+
+    QVector<Expected> expected;
+    QString fileName;
+
+    {
+        Log log( selfTestDir(logDir, "binary") );
+        if(!log.setBinaryLog()) return selfTestFailed(errorString, log.lastError());
+
+        // Small blocks, so queries cross many index entries
+        log.setIndexInterval(16, 4096);
+        fileName = log.binaryFileName();
+
+        for(int n = 0; n < 2000; ++n) {
+
+            const Log::LogType logType = static_cast<Log::LogType>(n % Log::LogOther);
+            const quint16 sourceId = static_cast<quint16>(n % 5);
+            const QString text = (n % 7 == 0)
+                    ? QString("line %1\nsecond line %2").arg(n).arg(QChar(0x00E4))
+                    : QString("message %1").arg(n);
+
+            log.saveSourceToLog(sourceId, text, logType);
+            expected.append( { logType, sourceId, text } );
+        }
+    }
+
+    LogReader reader;
+    if(!reader.open(fileName)) return selfTestFailed(errorString, reader.lastError());
+    if(!reader.hasIndex()) return selfTestFailed(errorString, "index not loaded");
+
+    reader.setUseIndex(false);
+    const QVector<LogReader::Record> records = reader.query(std::numeric_limits<qint64>::min(),
+                                                            std::numeric_limits<qint64>::max());
+    if(!reader.lastError().isEmpty()) return selfTestFailed(errorString, reader.lastError());
+
+    // The end line of the log follows the messages
+    if(records.size() < expected.size()) {
+        return selfTestFailed(errorString, QString("%1 records instead of %2")
+                              .arg(records.size()).arg(expected.size()));
+    }
+
+    for(int i = 0; i < expected.size(); ++i) {
+
+        const LogReader::Record &record = records.at(i);
+        const Expected &item = expected.at(i);
+
+        if((record.logType != item.logType) || (record.sourceId != item.sourceId)
+                || (record.text != item.text)) {
+            return selfTestFailed(errorString, QString("record %1 differs").arg(i));
+        }
+    }
+
+    // Index-assisted queries give exactly what a full scan gives
+    const qint64 middle = records.at(records.size() / 2).timestamp;
+    const quint32 masks[] = { LogReader::typeMask(Log::LogError),
+                              LogReader::typeMask(Log::LogIn) | LogReader::typeMask(Log::LogOut),
+                              LogReader::allTypes };
+
+    for(const quint32 mask: masks) {
+
+        reader.setUseIndex(false);
+        const QVector<LogReader::Record> scanned = reader.query(middle, middle, mask);
+        reader.setUseIndex(true);
+        const QVector<LogReader::Record> indexed = reader.query(middle, middle, mask);
+
+        bool same = (scanned.size() == indexed.size());
+        for(int i = 0; same && (i < scanned.size()); ++i) {
+            same = (scanned.at(i).timestamp == indexed.at(i).timestamp)
+                    && (scanned.at(i).text == indexed.at(i).text);
+        }
+
+        if(!same) {
+            return selfTestFailed(errorString, QString("indexed query (mask %1) gave "
+                                                       "%2 records, scan %3")
+                                  .arg(mask, 0, 16).arg(indexed.size()).arg(scanned.size()));
+        }
+    }
+
+    return true;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
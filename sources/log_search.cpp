@@ -0,0 +1,532 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QByteArrayMatcher>
+#include <QDir>
+#include <QEventLoop>
+#include <QRunnable>
+#include <cstring>
+#include <functional>
+
+#include "log_search.h"
+
+namespace nayk { //=============================================================
+
+const quint32 LogSearch::allTypes;
+
+//------------------------------------------------------------------------------
+static bool selfTestFailed(QString *errorString, const QString &text)
+{
+    if(errorString) *errorString = QString("LogSearch: %1").arg(text);
+    return false;
+}
+//------------------------------------------------------------------------------
+static QString selfTestDir(const QString &logDir, const QString &name)
+{
+    return QDir(logDir).absoluteFilePath( QString("%1_%2").arg(name)
+                                          .arg(QDateTime::currentMSecsSinceEpoch()) );
+}
+
+//==============================================================================
+class LogSearchTask : public QRunnable
+{
+public:
+    explicit LogSearchTask(const std::function<void()> &function) : m_function {function} {}
+    void run() override { m_function(); }
+
+private:
+    std::function<void()> m_function;
+};
+//==============================================================================
+LogSearch::LogSearch(QObject *parent) : QObject(parent)
+{
+}
+//==============================================================================
+LogSearch::~LogSearch()
+{
+    close();
+}
+//==============================================================================
+QString LogSearch::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool LogSearch::open(const QString &fileName)
+{
+    close();
+
+    m_file.setFileName(fileName);
+    if(!m_file.open(QIODevice::ReadOnly)) {
+        m_lastError = tr("Failed to open log file '%1': %2")
+                .arg(fileName)
+                .arg(m_file.errorString());
+        return false;
+    }
+
+    m_size = m_file.size();
+    if(m_size == 0) return true;
+
+    uchar *data = m_file.map(0, m_size);
+
+    if(!data) {
+        m_lastError = tr("Failed to map log file '%1': %2")
+                .arg(fileName)
+                .arg(m_file.errorString());
+        m_file.close();
+        m_size = 0;
+        return false;
+    }
+
+    m_data = reinterpret_cast<const char*>(data);
+    return true;
+}
+//==============================================================================
+void LogSearch::close()
+{
+    stop();
+
+    if(m_data) m_file.unmap( reinterpret_cast<uchar*>(const_cast<char*>(m_data)) );
+
+    m_data = nullptr;
+    m_size = 0;
+    m_file.close();
+}
+//==============================================================================
+bool LogSearch::isOpen() const
+{
+    return m_file.isOpen();
+}
+//==============================================================================
+qint64 LogSearch::size() const
+{
+    return m_size;
+}
+//==============================================================================
+QString LogSearch::substring() const
+{
+    return m_substring;
+}
+//==============================================================================
+Qt::CaseSensitivity LogSearch::caseSensitivity() const
+{
+    return m_cs;
+}
+//==============================================================================
+void LogSearch::setSubstring(const QString &substring, Qt::CaseSensitivity cs)
+{
+    m_substring = substring;
+    m_cs = cs;
+}
+//==============================================================================
+QRegularExpression LogSearch::regExp() const
+{
+    return m_regExp;
+}
+//==============================================================================
+void LogSearch::setRegExp(const QRegularExpression &regExp)
+{
+    m_regExp = regExp;
+}
+//==============================================================================
+quint32 LogSearch::typeFilter() const
+{
+    return m_typeFilter;
+}
+//==============================================================================
+void LogSearch::setTypeFilter(quint32 mask)
+{
+    m_typeFilter = mask;
+}
+//==============================================================================
+QTime LogSearch::timeFrom() const
+{
+    return m_timeFrom;
+}
+//==============================================================================
+QTime LogSearch::timeTo() const
+{
+    return m_timeTo;
+}
+//==============================================================================
+void LogSearch::setTimeRange(const QTime &from, const QTime &to)
+{
+    m_timeFrom = from;
+    m_timeTo = to;
+}
+//==============================================================================
+qint64 LogSearch::chunkSize() const
+{
+    return m_chunkSize;
+}
+//==============================================================================
+void LogSearch::setChunkSize(qint64 chunkSize)
+{
+    m_chunkSize = qMax<qint64>(4096, chunkSize);
+}
+//==============================================================================
+int LogSearch::maxResults() const
+{
+    return m_maxResults;
+}
+//==============================================================================
+void LogSearch::setMaxResults(int maxResults)
+{
+    m_maxResults = maxResults;
+}
+//==============================================================================
+int LogSearch::maxThreadCount() const
+{
+    return m_pool.maxThreadCount();
+}
+//==============================================================================
+void LogSearch::setMaxThreadCount(int maxThreadCount)
+{
+    m_pool.setMaxThreadCount( qMax(1, maxThreadCount) );
+}
+//==============================================================================
+bool LogSearch::isRunning() const
+{
+    return m_running;
+}
+//==============================================================================
+qint64 LogSearch::matchCount() const
+{
+    return m_matchCount;
+}
+//==============================================================================
+bool LogSearch::start()
+{
+    stop();
+
+    if(!m_file.isOpen()) {
+        m_lastError = tr("Log file is not open");
+        return false;
+    }
+
+    Filter filter;
+
+    if(m_cs == Qt::CaseSensitive) {
+        filter.substring = m_substring.toUtf8();
+    }
+    else {
+        filter.text = m_substring;
+        filter.cs = m_cs;
+    }
+
+    if(m_regExp.isValid() && !m_regExp.pattern().isEmpty()) filter.regExp = m_regExp;
+    filter.typeMask = m_typeFilter;
+
+    if(m_timeFrom.isValid() && m_timeTo.isValid()) {
+        filter.timeFrom = m_timeFrom.msecsSinceStartOfDay();
+        filter.timeTo = m_timeTo.msecsSinceStartOfDay();
+    }
+
+    // Chunk borders are moved forward to the next line start
+    m_chunks.clear();
+    m_chunks.append(0);
+
+    while(m_chunks.last() < m_size) {
+
+        qint64 next = m_chunks.last() + m_chunkSize;
+
+        if(next >= m_size) {
+            next = m_size;
+        }
+        else {
+            const void *eol = std::memchr(m_data + next, '\n', static_cast<size_t>(m_size - next));
+            next = eol ? (static_cast<const char*>(eol) - m_data + 1) : m_size;
+        }
+
+        m_chunks.append(next);
+    }
+
+    // A result limit keeps the newest matches, so the chunks are then
+    // queued and collected from the end of the file
+    const bool fromEnd = (m_maxResults >= 0);
+    const int chunkCount = m_chunks.size() - 1;
+
+    m_cancel = false;
+    m_pending.clear();
+    m_tail.clear();
+    m_nextChunk = fromEnd ? chunkCount - 1 : 0;
+    m_matchCount = 0;
+    m_running = true;
+
+    const quint64 generation = ++m_generation;
+
+    if((chunkCount < 1) || (m_maxResults == 0)) {
+        QMetaObject::invokeMethod(this, [this, generation]() {
+            if(generation == m_generation) finish();
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    for(int n = 0; n < chunkCount; ++n) {
+
+        const int i = fromEnd ? chunkCount - 1 - n : n;
+        const char *data = m_data + m_chunks.at(i);
+        const qint64 size = m_chunks.at(i + 1) - m_chunks.at(i);
+
+        m_pool.start(new LogSearchTask([this, generation, i, data, size, filter]() {
+
+            const QStringList lines = searchChunk(data, size, filter, m_cancel);
+            if(m_cancel) return;
+
+            QMetaObject::invokeMethod(this, [this, generation, i, lines]() {
+                chunkDone(generation, i, lines);
+            }, Qt::QueuedConnection);
+        }));
+    }
+
+    return true;
+}
+//==============================================================================
+void LogSearch::stop()
+{
+    m_cancel = true;
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    ++m_generation;
+    m_running = false;
+    m_pending.clear();
+    m_tail.clear();
+}
+//==============================================================================
+void LogSearch::chunkDone(quint64 generation, int index, const QStringList &lines)
+{
+    if(!m_running || (generation != m_generation)) return;
+
+    m_pending.insert(index, lines);
+
+    if(m_maxResults >= 0) {
+        tailChunkDone();
+        return;
+    }
+
+    while(m_pending.contains(m_nextChunk)) {
+
+        const QStringList chunk = m_pending.take(m_nextChunk++);
+        m_matchCount += chunk.size();
+
+        if(!chunk.isEmpty()) {
+            emit matched(chunk);
+            if(!m_running || (generation != m_generation)) return;
+        }
+    }
+
+    emit progress(m_chunks.at(m_nextChunk), m_size);
+
+    if(m_nextChunk >= m_chunks.size() - 1) finish();
+}
+//==============================================================================
+void LogSearch::tailChunkDone()
+{
+    // The last lines of each chunk, newest chunk first, until the limit is
+    // reached; they go out in one batch in file order
+    while(m_pending.contains(m_nextChunk)) {
+
+        const QStringList chunk = m_pending.take(m_nextChunk--);
+        const int count = qMin(chunk.size(), static_cast<int>(m_maxResults - m_matchCount));
+
+        if(count > 0) {
+            m_tail.prepend( chunk.mid(chunk.size() - count) );
+            m_matchCount += count;
+        }
+
+        if((m_matchCount < m_maxResults) && (m_nextChunk >= 0)) continue;
+
+        QStringList result;
+        result.reserve( static_cast<int>(m_matchCount) );
+        for(const QStringList &part: qAsConst(m_tail)) result.append(part);
+        m_tail.clear();
+
+        const quint64 generation = m_generation;
+        if(!result.isEmpty()) emit matched(result);
+        if(m_running && (generation == m_generation)) finish();
+        return;
+    }
+
+    emit progress(m_size - m_chunks.at(m_nextChunk + 1), m_size);
+}
+//==============================================================================
+void LogSearch::finish()
+{
+    // Chunks still in flight notice the flag and drop their results
+    m_cancel = true;
+    m_pool.clear();
+    m_running = false;
+    emit finished(m_matchCount);
+}
+//==============================================================================
+QStringList LogSearch::searchChunk(const char *data, qint64 size, const LogSearch::Filter &filter,
+                                   const std::atomic<bool> &cancel)
+{
+    QStringList lines;
+    const QByteArrayMatcher matcher(filter.substring);
+    const bool checkPrefix = (filter.typeMask != allTypes) || (filter.timeFrom >= 0);
+    const bool checkRegExp = !filter.regExp.pattern().isEmpty();
+    const char *pos = data;
+    const char *end = data + size;
+    int counter = 0;
+
+    while(pos < end) {
+
+        if(((++counter & 0xFFF) == 0) && cancel.load(std::memory_order_relaxed)) break;
+
+        const char *eol = static_cast<const char*>(
+                    std::memchr(pos, '\n', static_cast<size_t>(end - pos)) );
+        if(!eol) eol = end;
+
+        const char *line = pos;
+        int length = static_cast<int>(eol - pos);
+        pos = eol + 1;
+
+        if((length > 0) && (line[length - 1] == '\r')) --length;
+
+        // Cheap byte-level checks first, decode only the survivors
+        if(!filter.substring.isEmpty() && (matcher.indexIn(line, length) < 0)) continue;
+
+        if(checkPrefix) {
+
+            Log::LogType logType = Log::LogOther;
+            int msecs = -1;
+            Log::parseLogPrefix(line, length, logType, msecs);
+
+            if(!(filter.typeMask & (1u << static_cast<int>(logType)))) continue;
+
+            if(filter.timeFrom >= 0) {
+
+                if(msecs < 0) continue;
+
+                const bool inRange = (filter.timeFrom <= filter.timeTo)
+                        ? ((msecs >= filter.timeFrom) && (msecs <= filter.timeTo))
+                        : ((msecs >= filter.timeFrom) || (msecs <= filter.timeTo));
+                if(!inRange) continue;
+            }
+        }
+
+        const QString text = QString::fromUtf8(line, length);
+
+        if(!filter.text.isEmpty() && !text.contains(filter.text, filter.cs)) continue;
+        if(checkRegExp && !filter.regExp.match(text).hasMatch()) continue;
+
+        lines.append(text);
+    }
+
+    return lines;
+}
+//==============================================================================
+bool LogSearch::selfTest(const QString &logDir, QString *errorString)
+{
+    const int alphaCount = 300;
+    const int betaCount = 100;
+    QString fileName;
+
+    {
+        Log log( selfTestDir(logDir, "search") );
+
+        for(int n = 0; n < alphaCount; ++n) {
+            log.saveToLog( QString("alpha %1").arg(n), Log::LogInfo );
+            if(n % 3 == 0) log.saveToLog( QString("beta %1").arg(n / 3), Log::LogError );
+        }
+
+        fileName = log.logDir() + log.logFileName();
+    }
+
+    LogSearch search;
+    if(!search.open(fileName)) return selfTestFailed(errorString, search.lastError());
+
+    // Small chunks, so every filter runs over many of them
+    search.setChunkSize(4096);
+
+    const auto run = [&search](QStringList &lines) {
+
+        QEventLoop loop;
+        lines.clear();
+
+        const QMetaObject::Connection matched = QObject::connect(&search, &LogSearch::matched,
+                                                                 [&lines](const QStringList &chunk) {
+            lines.append(chunk);
+        });
+        const QMetaObject::Connection finished = QObject::connect(&search, &LogSearch::finished,
+                                                                  &loop, &QEventLoop::quit);
+        if(search.start()) loop.exec();
+
+        QObject::disconnect(matched);
+        QObject::disconnect(finished);
+    };
+
+    QStringList lines;
+
+    search.setSubstring("beta");
+    run(lines);
+    if(lines.size() != betaCount) {
+        return selfTestFailed(errorString, QString("%1 lines with \"beta\" instead of %2")
+                              .arg(lines.size()).arg(betaCount));
+    }
+
+    search.setSubstring("ALPHA", Qt::CaseInsensitive);
+    run(lines);
+    if(lines.size() != alphaCount) {
+        return selfTestFailed(errorString, QString("%1 lines with \"ALPHA\" (case "
+                                                   "insensitive) instead of %2")
+                              .arg(lines.size()).arg(alphaCount));
+    }
+
+    search.setSubstring("");
+    search.setTypeFilter( 1u << static_cast<int>(Log::LogError) );
+    run(lines);
+    if(lines.size() != betaCount) {
+        return selfTestFailed(errorString, QString("%1 error lines instead of %2")
+                              .arg(lines.size()).arg(betaCount));
+    }
+
+    // No line of a log written just now falls an hour or more ahead
+    const QTime now = QTime::currentTime();
+    search.setTypeFilter(allTypes);
+    search.setTimeRange(now.addSecs(3600), now.addSecs(7200));
+    run(lines);
+    if(!lines.isEmpty()) {
+        return selfTestFailed(errorString, QString("%1 lines outside the time range")
+                              .arg(lines.size()));
+    }
+
+    // A result limit keeps the newest matches, in file order
+    search.setTimeRange(QTime(), QTime());
+    search.setSubstring("alpha");
+    search.setMaxResults(5);
+    run(lines);
+    if((lines.size() != 5) || !lines.first().endsWith(QString("alpha %1").arg(alphaCount - 5))
+            || !lines.last().endsWith(QString("alpha %1").arg(alphaCount - 1))) {
+        return selfTestFailed(errorString, QString("limited search did not return "
+                                                   "the newest 5 matches in order"));
+    }
+
+    return true;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
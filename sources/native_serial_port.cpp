@@ -0,0 +1,716 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QtGlobal>
+#include <QObject>
+#include <QFile>
+
+#if defined (Q_OS_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
+
+#include "native_serial_port.h"
+#include "com_port.h"
+
+#if defined (Q_OS_LINUX) && defined (TCSETS2)
+// Kernel termios with free-form speeds for TCGETS2/TCSETS2; <asm/termbits.h>
+// declares it too but cannot be included together with <termios.h>
+struct termios2 {
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t c_line;
+    cc_t c_cc[19];
+    speed_t c_ispeed;
+    speed_t c_ospeed;
+};
+#    if !defined (BOTHER)
+#        define BOTHER 0010000
+#    endif
+#    define NAYK_CUSTOM_BAUD
+#endif
+
+namespace nayk { //=============================================================
+
+#if defined (Q_OS_LINUX)
+//------------------------------------------------------------------------------
+static speed_t baudRateToSpeed(qint32 baudRate)
+{
+    switch (baudRate) {
+    case 50:      return B50;
+    case 75:      return B75;
+    case 110:     return B110;
+    case 134:     return B134;
+    case 150:     return B150;
+    case 200:     return B200;
+    case 300:     return B300;
+    case 600:     return B600;
+    case 1200:    return B1200;
+    case 1800:    return B1800;
+    case 2400:    return B2400;
+    case 4800:    return B4800;
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 500000:  return B500000;
+    case 576000:  return B576000;
+    case 921600:  return B921600;
+    case 1000000: return B1000000;
+    case 1152000: return B1152000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 2500000: return B2500000;
+    case 3000000: return B3000000;
+    case 3500000: return B3500000;
+    case 4000000: return B4000000;
+    default: break;
+    }
+    return B0;
+}
+//------------------------------------------------------------------------------
+static QString errnoString()
+{
+    return QString::fromLocal8Bit( ::strerror(errno) );
+}
+//------------------------------------------------------------------------------
+#endif
+//==============================================================================
+NativeSerialPort::NativeSerialPort(RingBuffer *ringBuffer)
+    : m_ringBuffer {ringBuffer}
+{
+}
+//==============================================================================
+NativeSerialPort::~NativeSerialPort()
+{
+    close();
+}
+//==============================================================================
+QString NativeSerialPort::portName() const
+{
+    return m_portName;
+}
+//==============================================================================
+void NativeSerialPort::setPortName(const QString &portName)
+{
+    m_portName = portName;
+}
+//==============================================================================
+QString NativeSerialPort::errorString() const
+{
+    return m_errorString;
+}
+//==============================================================================
+qint32 NativeSerialPort::baudRate() const
+{
+    return m_baudRate;
+}
+//==============================================================================
+bool NativeSerialPort::setBaudRate(qint32 baudRate)
+{
+    return setSettings(baudRate, m_dataBits, m_stopBits, m_parity, m_flowControl);
+}
+//==============================================================================
+QSerialPort::DataBits NativeSerialPort::dataBits() const
+{
+    return m_dataBits;
+}
+//==============================================================================
+bool NativeSerialPort::setDataBits(QSerialPort::DataBits dataBits)
+{
+    return setSettings(m_baudRate, dataBits, m_stopBits, m_parity, m_flowControl);
+}
+//==============================================================================
+QSerialPort::StopBits NativeSerialPort::stopBits() const
+{
+    return m_stopBits;
+}
+//==============================================================================
+bool NativeSerialPort::setStopBits(QSerialPort::StopBits stopBits)
+{
+    return setSettings(m_baudRate, m_dataBits, stopBits, m_parity, m_flowControl);
+}
+//==============================================================================
+QSerialPort::Parity NativeSerialPort::parity() const
+{
+    return m_parity;
+}
+//==============================================================================
+bool NativeSerialPort::setParity(QSerialPort::Parity parity)
+{
+    return setSettings(m_baudRate, m_dataBits, m_stopBits, parity, m_flowControl);
+}
+//==============================================================================
+QSerialPort::FlowControl NativeSerialPort::flowControl() const
+{
+    return m_flowControl;
+}
+//==============================================================================
+bool NativeSerialPort::setFlowControl(QSerialPort::FlowControl flowControl)
+{
+    return setSettings(m_baudRate, m_dataBits, m_stopBits, m_parity, flowControl);
+}
+//==============================================================================
+bool NativeSerialPort::setSettings(qint32 baudRate, QSerialPort::DataBits dataBits,
+                                   QSerialPort::StopBits stopBits, QSerialPort::Parity parity,
+                                   QSerialPort::FlowControl flowControl)
+{
+#if defined (Q_OS_LINUX) && !defined (NAYK_CUSTOM_BAUD)
+    if(baudRateToSpeed(baudRate) == B0)
+        return setError( QObject::tr("Unsupported baud rate: %1").arg(baudRate) );
+#else
+    if(baudRate <= 0)
+        return setError( QObject::tr("Unsupported baud rate: %1").arg(baudRate) );
+#endif
+
+    if((dataBits < QSerialPort::Data5) || (dataBits > QSerialPort::Data8))
+        return setError( QObject::tr("Unsupported data bits: %1").arg(dataBits) );
+
+    if((stopBits != QSerialPort::OneStop) && (stopBits != QSerialPort::TwoStop))
+        return setError( QObject::tr("Unsupported stop bits") );
+
+    if(parity == QSerialPort::UnknownParity)
+        return setError( QObject::tr("Unsupported parity") );
+
+    if(flowControl == QSerialPort::UnknownFlowControl)
+        return setError( QObject::tr("Unsupported flow control") );
+
+    const qint32 previousBaudRate = m_baudRate;
+    const QSerialPort::DataBits previousDataBits = m_dataBits;
+    const QSerialPort::StopBits previousStopBits = m_stopBits;
+    const QSerialPort::Parity previousParity = m_parity;
+    const QSerialPort::FlowControl previousFlowControl = m_flowControl;
+
+    m_baudRate = baudRate;
+    m_dataBits = dataBits;
+    m_stopBits = stopBits;
+    m_parity = parity;
+    m_flowControl = flowControl;
+
+    if(applySettings()) return true;
+
+    m_baudRate = previousBaudRate;
+    m_dataBits = previousDataBits;
+    m_stopBits = previousStopBits;
+    m_parity = previousParity;
+    m_flowControl = previousFlowControl;
+    return false;
+}
+//==============================================================================
+int NativeSerialPort::readMinimum() const
+{
+    return m_readMinimum;
+}
+//==============================================================================
+bool NativeSerialPort::setReadMinimum(int readMinimum)
+{
+    m_readMinimum = qBound(0, readMinimum, 255);
+    return applySettings();
+}
+//==============================================================================
+int NativeSerialPort::readTimeout() const
+{
+    return m_readTimeout;
+}
+//==============================================================================
+bool NativeSerialPort::setReadTimeout(int deciseconds)
+{
+    m_readTimeout = qBound(0, deciseconds, 255);
+    return applySettings();
+}
+//==============================================================================
+bool NativeSerialPort::lowLatency() const
+{
+    return m_lowLatency;
+}
+//==============================================================================
+void NativeSerialPort::setLowLatency(bool lowLatency)
+{
+    m_lowLatency = lowLatency;
+    applySettings();
+}
+//==============================================================================
+qint64 NativeSerialPort::writeBufferSize() const
+{
+    return m_writeBufferSize;
+}
+//==============================================================================
+void NativeSerialPort::setWriteBufferSize(qint64 size)
+{
+    QMutexLocker locker(&m_txMutex);
+    m_writeBufferSize = qMax<qint64>(1, size);
+}
+//==============================================================================
+qint64 NativeSerialPort::bytesToWrite() const
+{
+    QMutexLocker locker(&m_txMutex);
+    return m_txBuffer.size();
+}
+//==============================================================================
+void NativeSerialPort::setReadLimit(qint64 limit, bool block)
+{
+    m_readLimit = qMax<qint64>(0, limit);
+    m_blockOnLimit = block;
+}
+//==============================================================================
+quint64 NativeSerialPort::limitDropped() const
+{
+    return m_limitDropped.load(std::memory_order_relaxed);
+}
+//==============================================================================
+void NativeSerialPort::setReadyReadHandler(const ReadyReadHandler &handler)
+{
+    m_readyReadHandler = handler;
+}
+//==============================================================================
+void NativeSerialPort::setErrorHandler(const ErrorHandler &handler)
+{
+    m_errorHandler = handler;
+}
+//==============================================================================
+bool NativeSerialPort::open(bool readOnly)
+{
+#if defined (Q_OS_LINUX)
+    if(isOpen()) return true;
+
+    const QString fileName = m_portName.startsWith('/') ? m_portName : "/dev/" + m_portName;
+
+    m_fd = ::open( QFile::encodeName(fileName).constData(),
+                   (readOnly ? O_RDONLY : O_RDWR) | O_NOCTTY | O_NONBLOCK | O_CLOEXEC );
+
+    if(m_fd < 0) return setError( errnoString() );
+
+    ::ioctl(m_fd, TIOCEXCL);
+
+    if(applySettings()) {
+
+        ::tcflush(m_fd, TCIOFLUSH);
+        m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event portEvent {};
+        portEvent.events = EPOLLIN;
+        portEvent.data.fd = m_fd;
+
+        epoll_event wakeEvent {};
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.fd = m_wakeFd;
+
+        if((m_epollFd >= 0) && (m_wakeFd >= 0)
+                && (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_fd, &portEvent) == 0)
+                && (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &wakeEvent) == 0)) {
+
+            m_stop = false;
+            m_paused = false;
+            m_txBuffer.clear();
+            m_thread = QThread::create([this]() { run(); });
+            m_thread->setObjectName( QString("NativeSerialPort_%1").arg(m_portName) );
+            m_thread->start(QThread::TimeCriticalPriority);
+            return true;
+        }
+
+        setError( errnoString() );
+    }
+
+    close();
+    return false;
+#else
+    Q_UNUSED(readOnly)
+    return setError( QObject::tr("Native serial port is not supported on this platform") );
+#endif
+}
+//==============================================================================
+void NativeSerialPort::close()
+{
+#if defined (Q_OS_LINUX)
+    if(m_thread) {
+
+        m_stop = true;
+        const quint64 value = 1;
+        if(::write(m_wakeFd, &value, sizeof(value)) < 0) {
+            m_errorString = errnoString();
+        }
+
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+    if(m_wakeFd >= 0) ::close(m_wakeFd);
+    if(m_epollFd >= 0) ::close(m_epollFd);
+    if(m_fd >= 0) ::close(m_fd);
+
+    m_wakeFd = -1;
+    m_epollFd = -1;
+    m_fd = -1;
+    m_txBuffer.clear();
+#else
+#endif
+}
+//==============================================================================
+bool NativeSerialPort::isOpen() const
+{
+    return m_fd >= 0;
+}
+//==============================================================================
+bool NativeSerialPort::isRequestToSend()
+{
+#if defined (Q_OS_LINUX)
+    if(m_fd < 0) return false;
+
+    int status = 0;
+    if(::ioctl(m_fd, TIOCMGET, &status) < 0) return false;
+
+    return (status & TIOCM_RTS) != 0;
+#else
+    return false;
+#endif
+}
+//==============================================================================
+qint64 NativeSerialPort::write(const char *data, qint64 size)
+{
+#if defined (Q_OS_LINUX)
+    if(m_fd < 0) {
+        setError( QObject::tr("Port is not open") );
+        return -1;
+    }
+
+    if(!data || (size <= 0)) return 0;
+
+    QMutexLocker locker(&m_txMutex);
+    qint64 written = 0;
+
+    // Goes straight to the driver while nothing is queued, what the driver
+    // does not take is left to the I/O thread to send on EPOLLOUT
+    while(m_txBuffer.isEmpty() && (written < size)) {
+
+        const ssize_t count = ::write(m_fd, data + written, static_cast<size_t>(size - written));
+
+        if(count > 0) {
+            written += count;
+            continue;
+        }
+
+        if((count < 0) && (errno == EINTR)) continue;
+        if((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) break;
+
+        setError( errnoString() );
+        return (written > 0) ? written : -1;
+    }
+
+    const qint64 queued = qBound<qint64>(0, m_writeBufferSize - m_txBuffer.size(), size - written);
+
+    if(queued > 0) {
+        m_txBuffer.append(data + written, static_cast<int>(queued));
+        updateEvents();
+    }
+
+    if(written + queued == 0) {
+        setError( QObject::tr("Write buffer is full") );
+        return -1;
+    }
+
+    return written + queued;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+    setError( QObject::tr("Native serial port is not supported on this platform") );
+    return -1;
+#endif
+}
+//==============================================================================
+bool NativeSerialPort::applySettings()
+{
+#if defined (Q_OS_LINUX)
+    if(m_fd < 0) return true;
+
+    termios tio;
+    if(::tcgetattr(m_fd, &tio) != 0) return setError( errnoString() );
+
+    ::cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~static_cast<tcflag_t>(CSIZE | CSTOPB | PARENB | PARODD | CMSPAR | CRTSCTS);
+    tio.c_iflag &= ~static_cast<tcflag_t>(IXON | IXOFF | IXANY | INPCK);
+
+    switch (m_dataBits) {
+    case QSerialPort::Data5: tio.c_cflag |= CS5; break;
+    case QSerialPort::Data6: tio.c_cflag |= CS6; break;
+    case QSerialPort::Data7: tio.c_cflag |= CS7; break;
+    default:                 tio.c_cflag |= CS8; break;
+    }
+
+    if(m_stopBits == QSerialPort::TwoStop) tio.c_cflag |= CSTOPB;
+
+    switch (m_parity) {
+    case QSerialPort::EvenParity:  tio.c_cflag |= PARENB; break;
+    case QSerialPort::OddParity:   tio.c_cflag |= PARENB | PARODD; break;
+    case QSerialPort::SpaceParity: tio.c_cflag |= PARENB | CMSPAR; break;
+    case QSerialPort::MarkParity:  tio.c_cflag |= PARENB | PARODD | CMSPAR; break;
+    default: break;
+    }
+
+    if(m_parity != QSerialPort::NoParity) tio.c_iflag |= INPCK;
+
+    if(m_flowControl == QSerialPort::HardwareControl) {
+        tio.c_cflag |= CRTSCTS;
+    }
+    else if(m_flowControl == QSerialPort::SoftwareControl) {
+        tio.c_iflag |= IXON | IXOFF | IXANY;
+    }
+
+    tio.c_cc[VMIN] = static_cast<cc_t>(m_readMinimum);
+    tio.c_cc[VTIME] = static_cast<cc_t>(m_readTimeout);
+
+    // Rates without a Bxxx constant are set through termios2 below
+    const speed_t speed = baudRateToSpeed(m_baudRate);
+    ::cfsetispeed(&tio, (speed == B0) ? B38400 : speed);
+    ::cfsetospeed(&tio, (speed == B0) ? B38400 : speed);
+
+    if(::tcsetattr(m_fd, TCSANOW, &tio) != 0) return setError( errnoString() );
+
+#if defined (NAYK_CUSTOM_BAUD)
+    if(speed == B0) {
+
+        termios2 tio2;
+        if(::ioctl(m_fd, TCGETS2, &tio2) != 0) return setError( errnoString() );
+
+        // Output and input (CIBAUD, CBAUD shifted by 16) speed fields
+        tio2.c_cflag &= ~static_cast<tcflag_t>(CBAUD | (CBAUD << 16));
+        tio2.c_cflag |= BOTHER | (BOTHER << 16);
+        tio2.c_ispeed = static_cast<speed_t>(m_baudRate);
+        tio2.c_ospeed = static_cast<speed_t>(m_baudRate);
+
+        if(::ioctl(m_fd, TCSETS2, &tio2) != 0) return setError( errnoString() );
+    }
+#endif
+
+    serial_struct serial;
+    if(::ioctl(m_fd, TIOCGSERIAL, &serial) == 0) {
+
+        if(m_lowLatency) {
+            serial.flags |= ASYNC_LOW_LATENCY;
+        }
+        else {
+            serial.flags &= ~ASYNC_LOW_LATENCY;
+        }
+
+        ::ioctl(m_fd, TIOCSSERIAL, &serial);
+    }
+
+    return true;
+#else
+    return true;
+#endif
+}
+//==============================================================================
+bool NativeSerialPort::setError(const QString &errorString)
+{
+    m_errorString = errorString;
+    return false;
+}
+//==============================================================================
+void NativeSerialPort::run()
+{
+#if defined (Q_OS_LINUX)
+    epoll_event events[2];
+
+    while(!m_stop) {
+
+        const int count = ::epoll_wait(m_epollFd, events, 2, -1);
+
+        if(count < 0) {
+            if(errno == EINTR) continue;
+            if(m_errorHandler) m_errorHandler( errnoString() );
+            return;
+        }
+
+        for(int i=0; i<count; ++i) {
+
+            if(events[i].data.fd == m_wakeFd) return;
+
+            if(events[i].events & EPOLLIN) {
+                if(!readAvailable()) return;
+            }
+
+            if(events[i].events & EPOLLOUT) {
+                if(!writePending()) return;
+            }
+
+            if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+                if(m_errorHandler) m_errorHandler( QObject::tr("Device disconnected") );
+                return;
+            }
+        }
+    }
+#else
+#endif
+}
+//==============================================================================
+void NativeSerialPort::pause()
+{
+#if defined (Q_OS_LINUX)
+    {
+        QMutexLocker locker(&m_txMutex);
+        m_paused = true;
+        updateEvents();
+    }
+
+    // The consumer may have drained the ring before it could see the pause
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_ringBuffer->size() < m_readLimit.load(std::memory_order_relaxed)) resume();
+#endif
+}
+//==============================================================================
+void NativeSerialPort::resume()
+{
+#if defined (Q_OS_LINUX)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!m_paused.exchange(false)) return;
+
+    QMutexLocker locker(&m_txMutex);
+    updateEvents();
+#endif
+}
+//==============================================================================
+bool NativeSerialPort::readAvailable()
+{
+#if defined (Q_OS_LINUX)
+    qint64 total = 0;
+    char scratch[256];
+
+    forever {
+
+        char *data = nullptr;
+        qint64 space = m_ringBuffer->writeSpace(&data);
+
+        const qint64 limit = m_readLimit.load(std::memory_order_relaxed);
+        const bool limited = (limit > 0) && (limit - m_ringBuffer->size() < space);
+        if(limited) space = qMax<qint64>(0, limit - m_ringBuffer->size());
+
+        if((space <= 0) && limited && m_blockOnLimit) {
+            pause();
+            break;
+        }
+
+        const ssize_t count = (space > 0)
+                ? ::read(m_fd, data, static_cast<size_t>(space))
+                : ::read(m_fd, scratch, sizeof(scratch));
+
+        if(count > 0) {
+
+            if(space > 0) {
+                m_ringBuffer->commitWrite(count, ComPort::monotonicTime());
+                total += count;
+            }
+            else if(limited) {
+                m_limitDropped.fetch_add(static_cast<quint64>(count), std::memory_order_relaxed);
+            }
+            else {
+                m_ringBuffer->addOverflow(count);
+            }
+            continue;
+        }
+
+        if(count == 0) break;
+        if(errno == EINTR) continue;
+        if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+
+        if(m_errorHandler) m_errorHandler( errnoString() );
+        return false;
+    }
+
+    if((total > 0) && m_readyReadHandler) m_readyReadHandler();
+    return true;
+#else
+    return false;
+#endif
+}
+//==============================================================================
+bool NativeSerialPort::writePending()
+{
+#if defined (Q_OS_LINUX)
+    QString errorString;
+
+    {
+        QMutexLocker locker(&m_txMutex);
+        qint64 written = 0;
+
+        while(written < m_txBuffer.size()) {
+
+            const ssize_t count = ::write(m_fd, m_txBuffer.constData() + written,
+                                          static_cast<size_t>(m_txBuffer.size() - written));
+
+            if(count > 0) {
+                written += count;
+                continue;
+            }
+
+            if((count < 0) && (errno == EINTR)) continue;
+            if((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) break;
+
+            errorString = errnoString();
+            break;
+        }
+
+        m_txBuffer.remove(0, static_cast<int>(written));
+        if(m_txBuffer.isEmpty()) updateEvents();
+    }
+
+    if(errorString.isEmpty()) return true;
+
+    if(m_errorHandler) m_errorHandler(errorString);
+    return false;
+#else
+    return false;
+#endif
+}
+//==============================================================================
+void NativeSerialPort::updateEvents()
+{
+#if defined (Q_OS_LINUX)
+    // Called with m_txMutex held: reading is off while paused by the read
+    // limit, writability is watched while queued data is waiting
+    epoll_event portEvent {};
+    portEvent.events = (m_paused ? 0u : static_cast<uint32_t>(EPOLLIN))
+            | (m_txBuffer.isEmpty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+    portEvent.data.fd = m_fd;
+
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_fd, &portEvent);
+#endif
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
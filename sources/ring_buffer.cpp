@@ -0,0 +1,290 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <cstring>
+
+#include "ring_buffer.h"
+
+namespace nayk { //=============================================================
+
+const qint64 RingBuffer::defaultCapacity;
+
+//------------------------------------------------------------------------------
+static bool selfTestFailed(QString *errorString, const QString &text)
+{
+    if(errorString) *errorString = QString("RingBuffer: %1").arg(text);
+    return false;
+}
+//------------------------------------------------------------------------------
+static quint64 roundUpToPowerOfTwo(qint64 value)
+{
+    quint64 result = 1;
+    while(result < static_cast<quint64>(qMax<qint64>(value, 1))) result <<= 1;
+    return result;
+}
+//==============================================================================
+RingBuffer::RingBuffer(qint64 capacity)
+{
+    setCapacity(capacity);
+}
+//==============================================================================
+qint64 RingBuffer::capacity() const
+{
+    return static_cast<qint64>(m_data.size());
+}
+//==============================================================================
+void RingBuffer::setCapacity(qint64 capacity)
+{
+    m_data.assign(roundUpToPowerOfTwo(capacity), 0);
+    m_mask = m_data.size() - 1;
+    clear();
+    resetStatistics();
+}
+//==============================================================================
+void RingBuffer::clear()
+{
+    m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+//==============================================================================
+bool RingBuffer::isEmpty() const
+{
+    return size() == 0;
+}
+//==============================================================================
+qint64 RingBuffer::size() const
+{
+    return static_cast<qint64>(m_head.load(std::memory_order_acquire)
+                               - m_tail.load(std::memory_order_acquire));
+}
+//==============================================================================
+qint64 RingBuffer::freeSpace() const
+{
+    return capacity() - size();
+}
+//==============================================================================
+qint64 RingBuffer::highWater() const
+{
+    return m_highWater.load(std::memory_order_relaxed);
+}
+//==============================================================================
+quint64 RingBuffer::overflowCount() const
+{
+    return m_overflowCount.load(std::memory_order_relaxed);
+}
+//==============================================================================
+quint64 RingBuffer::droppedBytes() const
+{
+    return m_droppedBytes.load(std::memory_order_relaxed);
+}
+//==============================================================================
+void RingBuffer::resetStatistics()
+{
+    m_highWater.store(size(), std::memory_order_relaxed);
+    m_overflowCount.store(0, std::memory_order_relaxed);
+    m_droppedBytes.store(0, std::memory_order_relaxed);
+}
+//==============================================================================
+qint64 RingBuffer::write(const char *data, qint64 size)
+{
+    return write(data, size, writeTimestamp());
+}
+//==============================================================================
+qint64 RingBuffer::write(const char *data, qint64 size, qint64 timestamp)
+{
+    qint64 written = 0;
+
+    while(written < size) {
+
+        char *space = nullptr;
+        qint64 count = qMin(writeSpace(&space), size - written);
+        if(count <= 0) break;
+
+        std::memcpy(space, data + written, static_cast<size_t>(count));
+        commitWrite(count, timestamp);
+        written += count;
+    }
+
+    if(written < size) addOverflow(size - written);
+    return written;
+}
+//==============================================================================
+qint64 RingBuffer::writeSpace(char **data) const
+{
+    const quint64 head = m_head.load(std::memory_order_relaxed);
+    const quint64 tail = m_tail.load(std::memory_order_acquire);
+    const quint64 offset = head & m_mask;
+    const quint64 free = m_data.size() - (head - tail);
+    const quint64 contiguous = qMin<quint64>(free, m_data.size() - offset);
+
+    *data = const_cast<char*>(m_data.data()) + offset;
+    return static_cast<qint64>(contiguous);
+}
+//==============================================================================
+void RingBuffer::commitWrite(qint64 count)
+{
+    if(count <= 0) return;
+
+    const quint64 head = m_head.load(std::memory_order_relaxed) + static_cast<quint64>(count);
+    m_head.store(head, std::memory_order_release);
+
+    const qint64 fill = static_cast<qint64>(head - m_tail.load(std::memory_order_acquire));
+    if(fill > m_highWater.load(std::memory_order_relaxed))
+        m_highWater.store(fill, std::memory_order_relaxed);
+}
+//==============================================================================
+void RingBuffer::commitWrite(qint64 count, qint64 timestamp)
+{
+    if(count <= 0) return;
+
+    m_writeTimestamp.store(timestamp, std::memory_order_relaxed);
+    commitWrite(count);
+}
+//==============================================================================
+qint64 RingBuffer::writeTimestamp() const
+{
+    return m_writeTimestamp.load(std::memory_order_relaxed);
+}
+//==============================================================================
+void RingBuffer::addOverflow(qint64 droppedCount)
+{
+    if(droppedCount <= 0) return;
+
+    m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+    m_droppedBytes.fetch_add(static_cast<quint64>(droppedCount), std::memory_order_relaxed);
+}
+//==============================================================================
+qint64 RingBuffer::read(char *data, qint64 maxSize)
+{
+    const quint64 tail = m_tail.load(std::memory_order_relaxed);
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 count = qMin<quint64>(head - tail, static_cast<quint64>(qMax<qint64>(maxSize, 0)));
+    if(count == 0) return 0;
+
+    const quint64 offset = tail & m_mask;
+    const quint64 first = qMin<quint64>(count, m_data.size() - offset);
+
+    std::memcpy(data, m_data.data() + offset, static_cast<size_t>(first));
+    if(first < count)
+        std::memcpy(data + first, m_data.data(), static_cast<size_t>(count - first));
+
+    m_tail.store(tail + count, std::memory_order_release);
+    return static_cast<qint64>(count);
+}
+//==============================================================================
+qint64 RingBuffer::read(QByteArray &buffer, qint64 maxSize)
+{
+    qint64 count = size();
+    if((maxSize >= 0) && (maxSize < count)) count = maxSize;
+
+    buffer.resize(static_cast<int>(count));
+    if(count == 0) return 0;
+
+    count = read(buffer.data(), count);
+    buffer.resize(static_cast<int>(count));
+    return count;
+}
+//==============================================================================
+qint64 RingBuffer::skip(qint64 maxSize)
+{
+    const quint64 tail = m_tail.load(std::memory_order_relaxed);
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 count = qMin<quint64>(head - tail, static_cast<quint64>(qMax<qint64>(maxSize, 0)));
+
+    m_tail.store(tail + count, std::memory_order_release);
+    return static_cast<qint64>(count);
+}
+//==============================================================================
+bool RingBuffer::selfTest(QString *errorString)
+{
+    // A small buffer and chunk sizes coprime to its capacity make the head
+    // cross the wrap point at every offset, both read overloads take turns
+    RingBuffer ring(10);
+    if(ring.capacity() != 16) {
+        return selfTestFailed(errorString, QString("capacity %1 instead of 16")
+                              .arg(ring.capacity()));
+    }
+
+    char data[16];
+    QByteArray chunk;
+    quint8 produced = 0;
+    quint8 consumed = 0;
+    quint64 dropped = 0;
+    quint64 overflows = 0;
+
+    for(int round=0; round<4096; ++round) {
+
+        const qint64 writeSize = 1 + round % 15;
+        const qint64 expected = qMin(writeSize, ring.freeSpace());
+        for(int i=0; i<writeSize; ++i) data[i] = static_cast<char>(produced + i);
+
+        const qint64 written = ring.write(data, writeSize, round);
+        if(written != expected) {
+            return selfTestFailed(errorString, QString("round %1 wrote %2 bytes instead of %3")
+                                  .arg(round).arg(written).arg(expected));
+        }
+        if((written > 0) && (ring.writeTimestamp() != round)) {
+            return selfTestFailed(errorString, QString("round %1 lost the write timestamp")
+                                  .arg(round));
+        }
+        if(written < writeSize) {
+            dropped += static_cast<quint64>(writeSize - written);
+            ++overflows;
+        }
+        produced = static_cast<quint8>(produced + written);
+
+        const qint64 readSize = 1 + (round * 7) % 13;
+        const bool intoArray = (round % 2) != 0;
+        const qint64 count = intoArray ? ring.read(chunk, readSize) : ring.read(data, readSize);
+        const char *bytes = intoArray ? chunk.constData() : data;
+
+        for(qint64 i=0; i<count; ++i, ++consumed) {
+            if(static_cast<quint8>(bytes[i]) != consumed) {
+                return selfTestFailed(errorString, QString("round %1 read byte %2 out of order")
+                                      .arg(round).arg(i));
+            }
+        }
+
+        if(ring.size() != static_cast<quint8>(produced - consumed)) {
+            return selfTestFailed(errorString, QString("round %1 size %2 instead of %3")
+                                  .arg(round).arg(ring.size())
+                                  .arg(static_cast<quint8>(produced - consumed)));
+        }
+    }
+
+    if((ring.droppedBytes() != dropped) || (ring.overflowCount() != overflows)) {
+        return selfTestFailed(errorString, QString("%1 overflows / %2 bytes dropped "
+                                                   "instead of %3 / %4")
+                              .arg(ring.overflowCount()).arg(ring.droppedBytes())
+                              .arg(overflows).arg(dropped));
+    }
+    if((overflows > 0) && (ring.highWater() != ring.capacity())) {
+        return selfTestFailed(errorString, QString("high water %1 instead of %2")
+                              .arg(ring.highWater()).arg(ring.capacity()));
+    }
+
+    return true;
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================
@@ -0,0 +1,454 @@
+/****************************************************************************
+** Copyright (c) 2019 Evgeny Teterin (nayk) <sutcedortal@gmail.com>
+** All right reserved.
+**
+** Permission is hereby granted, free of charge, to any person obtaining
+** a copy of this software and associated documentation files (the
+** "Software"), to deal in the Software without restriction, including
+** without limitation the rights to use, copy, modify, merge, publish,
+** distribute, sublicense, and/or sell copies of the Software, and to
+** permit persons to whom the Software is furnished to do so, subject to
+** the following conditions:
+**
+** The above copyright notice and this permission notice shall be
+** included in all copies or substantial portions of the Software.
+**
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+** EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+** MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+** NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+** LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+** OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+** WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+**
+****************************************************************************/
+#include <QRandomGenerator>
+#include <deque>
+
+#if defined (Q_OS_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "virtual_serial_link.h"
+#include "com_port_p.h"
+
+namespace nayk { //=============================================================
+
+//==============================================================================
+VirtualSerialLink::VirtualSerialLink(QObject *parent) : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &VirtualSerialLink::timer_timeout);
+
+    setLineFormat(9600);
+}
+//==============================================================================
+VirtualSerialLink::~VirtualSerialLink()
+{
+    closePty();
+    detach();
+}
+//==============================================================================
+QString VirtualSerialLink::lastError() const
+{
+    return m_lastError;
+}
+//==============================================================================
+bool VirtualSerialLink::attach(ComPort *first, ComPort *second)
+{
+    detach();
+
+    if(!first || !second || (first == second)) {
+        m_lastError = tr("Two different ports are required");
+        return false;
+    }
+
+    const ComPort::Backend firstBackend = first->backend();
+    const ComPort::Backend secondBackend = second->backend();
+
+    if(!first->setBackend(ComPort::BackendVirtual) || !second->setBackend(ComPort::BackendVirtual)) {
+        first->setBackend(firstBackend);
+        second->setBackend(secondBackend);
+        m_lastError = tr("Unable to attach an open port");
+        return false;
+    }
+
+    m_previousBackend[0] = firstBackend;
+    m_previousBackend[1] = secondBackend;
+
+    ComPortPrivate::setVirtualLink(first, this);
+    ComPortPrivate::setVirtualLink(second, this);
+    m_first = first;
+    m_second = second;
+    m_lineFree[0] = 0;
+    m_lineFree[1] = 0;
+    return true;
+}
+//==============================================================================
+void VirtualSerialLink::detach()
+{
+    m_timer.stop();
+    m_transfers.clear();
+
+    ComPort *ports[2] {m_first.data(), m_second.data()};
+
+    for(int i=0; i<2; ++i) {
+        if(!ports[i]) continue;
+        ports[i]->close();
+        ComPortPrivate::setVirtualLink(ports[i], nullptr);
+        ports[i]->setBackend(m_previousBackend[i]);
+    }
+
+    m_first = nullptr;
+    m_second = nullptr;
+}
+//==============================================================================
+bool VirtualSerialLink::openPty()
+{
+#if defined (Q_OS_LINUX)
+    closePty();
+
+    for(int i=0; i<2; ++i) {
+
+        char name[256];
+        if(::openpty(&m_masterFd[i], &m_slaveFd[i], name, nullptr, nullptr) != 0) {
+            m_lastError = QString::fromLocal8Bit( ::strerror(errno) );
+            closePty();
+            return false;
+        }
+
+        m_slaveName[i] = QString::fromLocal8Bit(name);
+
+        termios tio;
+        if(::tcgetattr(m_slaveFd[i], &tio) == 0) {
+            ::cfmakeraw(&tio);
+            ::tcsetattr(m_slaveFd[i], TCSANOW, &tio);
+        }
+
+        ::fcntl(m_masterFd[i], F_SETFL, ::fcntl(m_masterFd[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_wakeFd < 0) {
+        m_lastError = QString::fromLocal8Bit( ::strerror(errno) );
+        closePty();
+        return false;
+    }
+
+    m_stop = false;
+    m_thread = QThread::create([this]() { runPty(); });
+    m_thread->setObjectName("VirtualSerialLink");
+    m_thread->start(QThread::TimeCriticalPriority);
+    return true;
+#else
+    m_lastError = tr("Pseudo terminals are not supported on this platform");
+    return false;
+#endif
+}
+//==============================================================================
+void VirtualSerialLink::closePty()
+{
+#if defined (Q_OS_LINUX)
+    if(m_thread) {
+
+        m_stop = true;
+        const quint64 value = 1;
+        if(::write(m_wakeFd, &value, sizeof(value)) < 0) {
+            m_lastError = QString::fromLocal8Bit( ::strerror(errno) );
+        }
+
+        m_thread->wait();
+        delete m_thread;
+        m_thread = nullptr;
+    }
+
+    if(m_wakeFd >= 0) ::close(m_wakeFd);
+    m_wakeFd = -1;
+
+    for(int i=0; i<2; ++i) {
+        if(m_masterFd[i] >= 0) ::close(m_masterFd[i]);
+        if(m_slaveFd[i] >= 0) ::close(m_slaveFd[i]);
+        m_masterFd[i] = -1;
+        m_slaveFd[i] = -1;
+        m_slaveName[i].clear();
+    }
+#endif
+}
+//==============================================================================
+bool VirtualSerialLink::isPtyOpen() const
+{
+    return m_thread != nullptr;
+}
+//==============================================================================
+QString VirtualSerialLink::firstPortName() const
+{
+    return m_slaveName[0];
+}
+//==============================================================================
+QString VirtualSerialLink::secondPortName() const
+{
+    return m_slaveName[1];
+}
+//==============================================================================
+bool VirtualSerialLink::pacing() const
+{
+    return m_pacing;
+}
+//==============================================================================
+void VirtualSerialLink::setPacing(bool pacing)
+{
+    m_pacing = pacing;
+}
+//==============================================================================
+void VirtualSerialLink::setLineFormat(qint32 baudRate, QSerialPort::DataBits dataBits,
+                                      QSerialPort::Parity parity, QSerialPort::StopBits stopBits)
+{
+    m_ptyCharTime = ComPort::charTime(baudRate, dataBits, parity, stopBits);
+}
+//==============================================================================
+int VirtualSerialLink::latency() const
+{
+    return m_latency;
+}
+//==============================================================================
+void VirtualSerialLink::setLatency(int usec)
+{
+    m_latency = qMax(0, usec);
+}
+//==============================================================================
+double VirtualSerialLink::errorRate() const
+{
+    return m_errorRate;
+}
+//==============================================================================
+void VirtualSerialLink::setErrorRate(double errorRate)
+{
+    m_errorRate = qBound(0.0, errorRate, 1.0);
+}
+//==============================================================================
+double VirtualSerialLink::dropRate() const
+{
+    return m_dropRate;
+}
+//==============================================================================
+void VirtualSerialLink::setDropRate(double dropRate)
+{
+    m_dropRate = qBound(0.0, dropRate, 1.0);
+}
+//==============================================================================
+quint64 VirtualSerialLink::bytesTransferred() const
+{
+    return m_bytesTransferred;
+}
+//==============================================================================
+quint64 VirtualSerialLink::bytesCorrupted() const
+{
+    return m_bytesCorrupted;
+}
+//==============================================================================
+quint64 VirtualSerialLink::bytesDropped() const
+{
+    return m_bytesDropped;
+}
+//==============================================================================
+void VirtualSerialLink::resetCounters()
+{
+    m_bytesTransferred = 0;
+    m_bytesCorrupted = 0;
+    m_bytesDropped = 0;
+}
+//==============================================================================
+qint64 VirtualSerialLink::transmit(ComPort *from, const char *data, qint64 size)
+{
+    const int line = (from == m_first) ? 0 : 1;
+
+    Transfer transfer;
+    transfer.port = (line == 0) ? m_second : m_first;
+    transfer.charTime = m_pacing ? from->charTime() : 0;
+    transfer.data = QByteArray(data, static_cast<int>(size));
+    applyErrors(transfer.data);
+
+    // Characters leave the sender back to back, a new write waits for the line
+    const qint64 start = qMax(ComPort::monotonicTime(), m_lineFree[line]);
+    m_lineFree[line] = start + size * transfer.charTime;
+    transfer.start = start + static_cast<qint64>(m_latency) * 1000;
+
+    m_transfers.append(transfer);
+    if(!m_timer.isActive()) m_timer.start(0);
+
+    return size;
+}
+//==============================================================================
+void VirtualSerialLink::applyErrors(QByteArray &bytes)
+{
+    const double errorRate = m_errorRate;
+    const double dropRate = m_dropRate;
+
+    if((errorRate > 0.0) || (dropRate > 0.0)) {
+
+        QRandomGenerator *random = QRandomGenerator::global();
+        int size = 0;
+
+        for(int i=0; i<bytes.size(); ++i) {
+
+            if((dropRate > 0.0) && (random->generateDouble() < dropRate)) {
+                ++m_bytesDropped;
+                continue;
+            }
+
+            char value = bytes.at(i);
+            if((errorRate > 0.0) && (random->generateDouble() < errorRate)) {
+                value = static_cast<char>(value ^ (1 << random->bounded(8)));
+                ++m_bytesCorrupted;
+            }
+
+            bytes[size++] = value;
+        }
+
+        bytes.resize(size);
+    }
+
+    m_bytesTransferred += static_cast<quint64>(bytes.size());
+}
+//==============================================================================
+void VirtualSerialLink::runPty()
+{
+#if defined (Q_OS_LINUX)
+    struct Chunk {
+        qint64 due;
+        QByteArray data;
+    };
+
+    std::deque<Chunk> queues[2];
+    qint64 lineFree[2] {0, 0};
+    bool blocked[2] {false, false};
+    QByteArray buffer(ptyBufferSize, 0);
+
+    while(!m_stop) {
+
+        qint64 now = ComPort::monotonicTime();
+        int timeout = -1;
+
+        // A queue whose target master is full waits for POLLOUT, not a timer
+        for(int i=0; i<2; ++i) {
+            if(queues[i].empty() || blocked[i]) continue;
+            const int wait = static_cast<int>(qMax<qint64>(0, (queues[i].front().due - now + 999999) / 1000000));
+            timeout = (timeout < 0) ? wait : qMin(timeout, wait);
+        }
+
+        pollfd descriptors[3] {};
+        descriptors[0].fd = m_masterFd[0];
+        descriptors[0].events = POLLIN | (blocked[1] ? POLLOUT : 0);
+        descriptors[1].fd = m_masterFd[1];
+        descriptors[1].events = POLLIN | (blocked[0] ? POLLOUT : 0);
+        descriptors[2].fd = m_wakeFd;
+        descriptors[2].events = POLLIN;
+
+        if((::poll(descriptors, 3, timeout) < 0) && (errno != EINTR)) return;
+        if(descriptors[2].revents & POLLIN) return;
+
+        for(int i=0; i<2; ++i) {
+            if(descriptors[1 - i].revents & (POLLOUT | POLLERR | POLLHUP)) blocked[i] = false;
+        }
+
+        now = ComPort::monotonicTime();
+        const qint64 charTime = m_pacing ? m_ptyCharTime.load() : 0;
+
+        for(int i=0; i<2; ++i) {
+
+            if(!(descriptors[i].revents & POLLIN)) continue;
+
+            const ssize_t count = ::read(m_masterFd[i], buffer.data(), static_cast<size_t>(buffer.size()));
+            if(count <= 0) continue;
+
+            Chunk chunk;
+            chunk.data = QByteArray(buffer.constData(), static_cast<int>(count));
+            applyErrors(chunk.data);
+
+            lineFree[i] = qMax(now, lineFree[i]) + count * charTime;
+            chunk.due = lineFree[i] + static_cast<qint64>(m_latency) * 1000;
+            queues[i].push_back(chunk);
+        }
+
+        for(int i=0; i<2; ++i) {
+
+            std::deque<Chunk> &queue = queues[i];
+
+            while(!blocked[i] && !queue.empty() && (queue.front().due <= now)) {
+
+                Chunk &chunk = queue.front();
+                const ssize_t count = chunk.data.isEmpty()
+                        ? 0
+                        : ::write(m_masterFd[1 - i], chunk.data.constData(),
+                                  static_cast<size_t>(chunk.data.size()));
+
+                if((count < 0) && (errno == EINTR)) continue;
+
+                if((count < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                    m_bytesDropped += static_cast<quint64>(chunk.data.size());
+                    queue.pop_front();
+                    continue;
+                }
+
+                if(count > 0) chunk.data.remove(0, static_cast<int>(count));
+
+                if(!chunk.data.isEmpty()) {
+                    blocked[i] = true;
+                    break;
+                }
+
+                queue.pop_front();
+            }
+        }
+    }
+#endif
+}
+//==============================================================================
+void VirtualSerialLink::timer_timeout()
+{
+    const qint64 now = ComPort::monotonicTime();
+    int index = 0;
+
+    while(index < m_transfers.size()) {
+
+        Transfer &transfer = m_transfers[index];
+        const int size = transfer.data.size();
+        int arrived = size;
+
+        if(now < transfer.start) {
+            arrived = 0;
+        }
+        else if(transfer.charTime > 0) {
+            arrived = static_cast<int>(qMin<qint64>(size, (now - transfer.start) / transfer.charTime));
+        }
+
+        if((arrived > transfer.delivered) && transfer.port) {
+            ComPortPrivate::receiveVirtual(transfer.port,
+                                           transfer.data.constData() + transfer.delivered,
+                                           arrived - transfer.delivered,
+                                           transfer.start + arrived * transfer.charTime);
+        }
+
+        transfer.delivered = arrived;
+
+        if(transfer.delivered >= size) {
+            m_transfers.remove(index);
+        }
+        else {
+            ++index;
+        }
+    }
+
+    if(!m_transfers.isEmpty()) m_timer.start(tickInterval);
+}
+//==============================================================================
+
+} // namespace nayk //==========================================================